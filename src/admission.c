@@ -0,0 +1,197 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <stdbool.h>
+
+#include "admission.h"
+#include "cpthread.h"
+#include "rw_files.h"
+#include "xmem.h"
+
+/* - - - - */
+
+struct admission_item {
+    void                  *item;
+    int64_t                bytes; /*!< Space the item needs. */
+    struct admission_item *next;
+};
+typedef struct admission_item admission_item_t;
+
+struct admission {
+    char               *dir;
+    int64_t             reserve;       /*!< Bytes to always leave free. */
+    int64_t             reserved;      /*!< Bytes reserved by downloads that aren't on disk yet. */
+    size_t              inflight;      /*!< Downloads admitted and not released. */
+    admission_item_t   *deferred;      /*!< Items waiting for space. */
+    admission_item_t   *deferred_last;
+    admission_retry_cb  retry;
+    pthread_mutex_t     mutex;
+};
+
+/* - - - - */
+
+admission_t *admission_create(const char *dir, int64_t reserve, admission_retry_cb retry)
+{
+    admission_t *adm;
+
+    if (dir == NULL || retry == NULL)
+        return NULL;
+
+    adm          = xcalloc(1, sizeof(*adm));
+    adm->dir     = xstrdup(dir);
+    adm->reserve = reserve<0?0:reserve;
+    adm->retry   = retry;
+    pthread_mutex_init(&(adm->mutex), NULL);
+
+    return adm;
+}
+
+void admission_destroy(admission_t *adm)
+{
+    admission_item_t *ai;
+
+    if (adm == NULL)
+        return;
+
+    while (adm->deferred != NULL) {
+        ai            = adm->deferred;
+        adm->deferred = ai->next;
+        xfree(ai);
+    }
+
+    pthread_mutex_destroy(&(adm->mutex));
+    xfree(adm->dir);
+    xfree(adm);
+}
+
+admission_result_t admission_reserve(admission_t *adm, int64_t bytes, void *item)
+{
+    admission_item_t   *ai;
+    admission_result_t  ret = ADMISSION_ADMIT;
+    int64_t             avail;
+
+    if (adm == NULL)
+        return ADMISSION_ADMIT;
+    if (bytes < 0)
+        bytes = 0;
+
+    pthread_mutex_lock(&(adm->mutex));
+
+    if (bytes > 0) {
+        /* If we can't tell how much space there is, don't block downloads. */
+        avail = rw_free_space(adm->dir);
+        if (avail >= 0 && avail - adm->reserve - adm->reserved < bytes) {
+            ret = adm->inflight==0?ADMISSION_REJECT:ADMISSION_DEFER;
+        }
+    }
+
+    if (ret == ADMISSION_ADMIT) {
+        adm->reserved += bytes;
+        adm->inflight++;
+    } else if (ret == ADMISSION_DEFER) {
+        ai        = xcalloc(1, sizeof(*ai));
+        ai->item  = item;
+        ai->bytes = bytes;
+        if (adm->deferred_last == NULL) {
+            adm->deferred = ai;
+        } else {
+            adm->deferred_last->next = ai;
+        }
+        adm->deferred_last = ai;
+    }
+
+    pthread_mutex_unlock(&(adm->mutex));
+    return ret;
+}
+
+void admission_settle(admission_t *adm, int64_t bytes)
+{
+    if (adm == NULL || bytes <= 0)
+        return;
+
+    pthread_mutex_lock(&(adm->mutex));
+    adm->reserved -= bytes;
+    if (adm->reserved < 0)
+        adm->reserved = 0;
+    pthread_mutex_unlock(&(adm->mutex));
+}
+
+void admission_release(admission_t *adm, int64_t bytes)
+{
+    admission_item_t *ai;
+    admission_item_t *wake      = NULL;
+    admission_item_t *wake_last = NULL;
+    int64_t           avail;
+    bool              known;
+
+    if (adm == NULL)
+        return;
+
+    pthread_mutex_lock(&(adm->mutex));
+    if (bytes > 0)
+        adm->reserved -= bytes;
+    if (adm->reserved < 0)
+        adm->reserved = 0;
+    if (adm->inflight > 0)
+        adm->inflight--;
+
+    /* Only as many deferred items as the space now free can hold get
+     * another chance. The rest would only be deferred again. They're
+     * taken in order so a large item isn't passed over by smaller ones
+     * forever. Once nothing is running everything left is handed back
+     * because there is nothing left to wait on. It will either fit or
+     * be rejected.
+     *
+     * Taken under the lock so an item deferred concurrently is either
+     * considered here or sees this download as finished. */
+    avail = rw_free_space(adm->dir);
+    known = avail >= 0;
+    avail -= adm->reserve + adm->reserved;
+    while (adm->deferred != NULL) {
+        ai = adm->deferred;
+        if (adm->inflight > 0 && known && ai->bytes > avail)
+            break;
+        avail -= ai->bytes;
+
+        adm->deferred = ai->next;
+        ai->next      = NULL;
+        if (wake_last == NULL) {
+            wake = ai;
+        } else {
+            wake_last->next = ai;
+        }
+        wake_last = ai;
+    }
+    if (adm->deferred == NULL)
+        adm->deferred_last = NULL;
+    pthread_mutex_unlock(&(adm->mutex));
+
+    /* The caller is still running so whatever is waiting on it can't
+     * finish before the retries are queued. */
+    while (wake != NULL) {
+        ai   = wake;
+        wake = ai->next;
+        adm->retry(ai->item);
+        xfree(ai);
+    }
+}
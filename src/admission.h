@@ -0,0 +1,116 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __ADMISSION_H__
+#define __ADMISSION_H__
+
+#include <stdint.h>
+
+/*! \addtogroup admission Disk Space Admission
+ *
+ * Keeps downloads from filling the disk. Each download reserves the space
+ * it needs before starting. A download is admitted when the free space on
+ * the file system, minus a reserve that's always kept free, minus the space
+ * reserved by downloads still in progress, can hold it.
+ *
+ * Downloads that don't fit are deferred and handed back through the retry
+ * callback when a running download finishes and frees enough space for
+ * them.
+ * A download that doesn't fit when nothing else is running will never fit
+ * and is rejected.
+ *
+ * @{
+ */
+
+struct admission;
+typedef struct admission admission_t;
+
+/*! Called with a deferred item when it should be tried again. */
+typedef void (*admission_retry_cb)(void *item);
+
+/*! Result of trying to reserve space. */
+typedef enum {
+    ADMISSION_ADMIT = 0, /*!< Space reserved. Must be released. */
+    ADMISSION_DEFER,     /*!< Not enough space now. The item will be retried. */
+    ADMISSION_REJECT     /*!< Not enough space even with nothing running. */
+} admission_result_t;
+
+/* - - - - */
+
+/*! Create an admission controller.
+ *
+ * \param[in] dir     Directory downloads are written to. Used to determine
+ *                    free space.
+ * \param[in] reserve Bytes to always leave free.
+ * \param[in] retry   Callback for deferred items.
+ *
+ * \return Admission controller.
+ */
+admission_t *admission_create(const char *dir, int64_t reserve, admission_retry_cb retry);
+
+/*! Destroy an admission controller.
+ *
+ * There must be nothing deferred or in progress.
+ *
+ * \param[in,out] adm Admission controller.
+ */
+void admission_destroy(admission_t *adm);
+
+/*! Reserve space for a download.
+ *
+ * \param[in,out] adm   Admission controller.
+ * \param[in]     bytes Space needed. 0 if unknown. Unknown sizes are always
+ *                      admitted but count as in progress.
+ * \param[in]     item  Item to pass to the retry callback if deferred.
+ *
+ * \return Result.
+ */
+admission_result_t admission_reserve(admission_t *adm, int64_t bytes, void *item);
+
+/*! Mark reserved space as allocated on disk.
+ *
+ * Once the file system reports the space as used it's no longer counted
+ * against the reservation. The download is still in progress.
+ *
+ * \param[in,out] adm   Admission controller.
+ * \param[in]     bytes Bytes that were allocated. Must not exceed
+ *                      the amount reserved.
+ */
+void admission_settle(admission_t *adm, int64_t bytes);
+
+/*! Finish a download that was admitted.
+ *
+ * Deferred items are passed to the retry callback in the order they were
+ * deferred, for as long as the free space can hold them. When nothing is
+ * left running all of them are.
+ *
+ * \param[in,out] adm   Admission controller.
+ * \param[in]     bytes Bytes still reserved. The amount reserved minus
+ *                      any that were settled.
+ */
+void admission_release(admission_t *adm, int64_t bytes);
+
+/*! @}
+ */
+
+#endif /* __ADMISSION_H__ */
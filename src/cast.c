@@ -25,29 +25,60 @@
 #include <string.h>
 
 #include "cast.h"
+#include "cpthread.h"
 #include "rw_files.h"
+#include "str_builder.h"
 #include "str_helpers.h"
+#include "xarena.h"
 #include "xmem.h"
 
 /* - - - - */
 
+/* Episodes hold a reference to their cast instead of copying
+ * the cast's information. */
 struct cast_s {
-    char *name;
-    char *category;
-    char *url;
-    char *prefix_path;
-    bool  allow_explicit;
+    char            *name;
+    char            *category;
+    char            *url;
+    char            *prefix_path;
+    char            *key;
+    xarena_t        *arena;          /*!< Created on first use. */
+    volatile size_t  refcnt;
+    bool             allow_explicit;
 };
 
 struct cast_ep_s {
+    cast_t *cast;
     char   *url;
-    char   *castname;
-    char   *path_prefix;
+    char   *id;
+    char   *final_url; /*!< Where the URL redirects to. Heap allocated. */
     size_t  len;
+    bool    noresume;  /*!< The server said it can't send part of the file. */
 };
 
 /* - - - - */
 
+/* The same feed can be listed more than once to download it to different
+ * places. The key tells them apart. A space can't be in a URL so the
+ * URL and path can't run together into something ambiguous. */
+static void cast_update_key(cast_t *cast)
+{
+    str_builder_t *sb;
+
+    xfree(cast->key);
+    if (str_isempty(cast->prefix_path)) {
+        cast->key = str_strdup_safe(cast->url);
+        return;
+    }
+
+    sb = str_builder_create();
+    str_builder_add_str(sb, cast->url);
+    str_builder_add_char(sb, ' ');
+    str_builder_add_str(sb, cast->prefix_path);
+    cast->key = str_builder_dump(sb, NULL);
+    str_builder_destroy(sb);
+}
+
 static void cast_update_prefix_path(cast_t *cast)
 {
     if (cast == NULL)
@@ -56,8 +87,10 @@ static void cast_update_prefix_path(cast_t *cast)
     xfree(cast->prefix_path);
     cast->prefix_path = NULL;
 
-    if (str_isempty(cast->name) && str_isempty(cast->category))
+    if (str_isempty(cast->name) && str_isempty(cast->category)) {
+        cast_update_key(cast);
         return;
+    }
 
     if (str_isempty(cast->name)) {
         cast->prefix_path = str_strdup_safe(cast->category);
@@ -66,6 +99,7 @@ static void cast_update_prefix_path(cast_t *cast)
     } else {
         cast->prefix_path = rw_join_path(2, cast->category, cast->name);
     }
+    cast_update_key(cast);
 }
 
 /* - - - - */
@@ -79,22 +113,38 @@ cast_t *cast_create(const char *url)
 
     cast                 = xcalloc(1, sizeof(*cast));
     cast->url            = str_strdup_safe(url);
+    cast->key            = str_strdup_safe(url);
+    cast->refcnt         = 1;
     cast->allow_explicit = true;
 
     return cast;
 }
 
-void cast_destroy(cast_t *cast)
+cast_t *cast_retain(cast_t *cast)
+{
+    if (cast == NULL)
+        return NULL;
+
+    cpthread_atomic_inc(&(cast->refcnt));
+    return cast;
+}
+
+void cast_release(cast_t *cast)
 {
     if (cast == NULL)
         return;
 
+    if (cpthread_atomic_dec(&(cast->refcnt)) > 0)
+        return;
+
     xfree(cast->name);
     xfree(cast->category);
     xfree(cast->url);
     xfree(cast->prefix_path);
+    xfree(cast->key);
+    xarena_release(cast->arena);
 
-    free(cast);
+    xfree(cast);
 }
 
 void cast_set_name(cast_t *cast, const char *name)
@@ -167,23 +217,37 @@ const char *cast_prefix_path(const cast_t *cast)
     return cast->prefix_path;
 }
 
+const char *cast_key(const cast_t *cast)
+{
+    if (cast == NULL)
+        return NULL;
+    return cast->key;
+}
+
+xarena_t *cast_arena(cast_t *cast)
+{
+    if (cast == NULL)
+        return NULL;
+
+    if (cast->arena == NULL)
+        cast->arena = xarena_create(0);
+    return cast->arena;
+}
+
 /* - - - - */
 
-cast_ep_t *cast_ep_create(const char *url, const char *castname, const char *path_prefix)
+cast_ep_t *cast_ep_create(cast_t *cast, const char *url)
 {
+    xarena_t  *arena;
     cast_ep_t *castep;
 
-    if (str_isempty(url))
+    if (cast == NULL || str_isempty(url))
         return NULL;
 
-    castep      = xcalloc(1, sizeof(*castep));
-    castep->url = str_strdup_safe(url);
-
-    if (!str_isempty(castname))
-        castep->castname = strdup(castname);
-
-    if (!str_isempty(path_prefix))
-        castep->path_prefix = strdup(path_prefix);
+    arena        = cast_arena(cast);
+    castep       = xarena_calloc(arena, 1, sizeof(*castep));
+    castep->cast = cast_retain(cast);
+    castep->url  = xarena_strdup(arena, url);
 
     return castep;
 }
@@ -193,27 +257,40 @@ void cast_ep_destory(cast_ep_t *castep)
     if (castep == NULL)
         return;
 
-    xfree(castep->url);
-    xfree(castep->castname);
-    xfree(castep->path_prefix);
+    /* The episode itself is owned by the cast's arena. */
+    xfree(castep->final_url);
+    cast_release(castep->cast);
+}
 
-    free(castep);
+void cast_ep_set_size(cast_ep_t *castep, size_t len)
+{
+    if (castep == NULL || len == 0)
+        return;
+    castep->len = len;
 }
 
-void cast_ep_set_castname(cast_ep_t *castep, const char *castname)
+void cast_ep_set_resumable(cast_ep_t *castep, bool resumable)
 {
-    if (castep == NULL || str_isempty(castname))
+    if (castep == NULL)
         return;
+    castep->noresume = !resumable;
+}
 
-    xfree(castep->castname);
-    castep->castname = strdup(castname);
+void cast_ep_set_id(cast_ep_t *castep, const char *id)
+{
+    if (castep == NULL || str_isempty(id))
+        return;
+    castep->id = xarena_strdup(cast_arena(castep->cast), id);
 }
 
-void cast_ep_set_size(cast_ep_t *castep, size_t len)
+void cast_ep_set_final_url(cast_ep_t *castep, const char *url)
 {
-    if (castep == NULL || len == 0)
+    if (castep == NULL)
         return;
-    castep->len = len;
+    xfree(castep->final_url);
+    castep->final_url = NULL;
+    if (!str_isempty(url))
+        castep->final_url = xstrdup(url);
 }
 
 const char *cast_ep_url(const cast_ep_t *castep)
@@ -223,18 +300,41 @@ const char *cast_ep_url(const cast_ep_t *castep)
     return castep->url;
 }
 
+const char *cast_ep_final_url(const cast_ep_t *castep)
+{
+    if (castep == NULL)
+        return NULL;
+    return castep->final_url;
+}
+
+const char *cast_ep_id(const cast_ep_t *castep)
+{
+    if (castep == NULL)
+        return NULL;
+    if (castep->id == NULL)
+        return castep->url;
+    return castep->id;
+}
+
+cast_t *cast_ep_cast(const cast_ep_t *castep)
+{
+    if (castep == NULL)
+        return NULL;
+    return castep->cast;
+}
+
 const char *cast_ep_castname(const cast_ep_t *castep)
 {
     if (castep == NULL)
         return NULL;
-    return castep->castname;
+    return cast_name(castep->cast);
 }
 
 const char *cast_ep_prefix_path(const cast_ep_t *castep)
 {
     if (castep == NULL)
         return NULL;
-    return castep->path_prefix;
+    return cast_prefix_path(castep->cast);
 }
 
 size_t cast_ep_size(const cast_ep_t *castep)
@@ -243,3 +343,10 @@ size_t cast_ep_size(const cast_ep_t *castep)
         return 0;
     return castep->len;
 }
+
+bool cast_ep_resumable(const cast_ep_t *castep)
+{
+    if (castep == NULL)
+        return false;
+    return !castep->noresume;
+}
@@ -25,6 +25,9 @@
 #define __CAST_H__
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "xarena.h"
 
 /* - - - - */
 
@@ -36,8 +39,11 @@ typedef struct cast_ep_s cast_ep_t;
 
 /* - - - - */
 
+/* Casts are reference counted. cast_create returns a cast with one
+ * reference and it is freed when the last reference is released. */
 cast_t *cast_create(const char *url);
-void cast_destroy(cast_t *cast);
+cast_t *cast_retain(cast_t *cast);
+void cast_release(cast_t *cast);
 
 void cast_set_name(cast_t *cast, const char *name);
 void cast_set_category(cast_t *cast, const char *category);
@@ -48,17 +54,39 @@ const char *cast_name(const cast_t *cast);
 const char *cast_category(const cast_t *cast);
 bool cast_allow_explicit(const cast_t *cast);
 const char *cast_prefix_path(const cast_t *cast);
+/* Identifies the cast. The URL plus where it's downloaded to. */
+const char *cast_key(const cast_t *cast);
+/* Arena for objects that live as long as the cast. Allocating
+ * from it is not thread safe. */
+xarena_t *cast_arena(cast_t *cast);
 
 /* - - - - */
 
-cast_ep_t *cast_ep_create(const char *url, const char *castname, const char *path_prefix);
+/* The episode is allocated from the cast's arena and holds a reference
+ * to the cast. */
+cast_ep_t *cast_ep_create(cast_t *cast, const char *url);
 void cast_ep_destory(cast_ep_t *castep);
 
 void cast_ep_set_size(cast_ep_t *castep, size_t len);
+/* Whether an interrupted download can be resumed. Assumed
+ * to be unless the server said otherwise. */
+void cast_ep_set_resumable(cast_ep_t *castep, bool resumable);
+/* Identifies the episode within the feed (the item's guid). Allocated
+ * from the cast's arena so it has the same restrictions. */
+void cast_ep_set_id(cast_ep_t *castep, const char *id);
+/* Where the URL redirects to when it's been looked up. Unlike the id
+ * it's heap allocated so it can be set from any thread. */
+void cast_ep_set_final_url(cast_ep_t *castep, const char *url);
 
 const char *cast_ep_url(const cast_ep_t *castep);
+/* NULL if it hasn't been looked up. */
+const char *cast_ep_final_url(const cast_ep_t *castep);
+/* The URL if no id was set. */
+const char *cast_ep_id(const cast_ep_t *castep);
+cast_t *cast_ep_cast(const cast_ep_t *castep);
 const char *cast_ep_castname(const cast_ep_t *castep);
 const char *cast_ep_prefix_path(const cast_ep_t *castep);
 size_t cast_ep_size(const cast_ep_t *castep);
+bool cast_ep_resumable(const cast_ep_t *castep);
 
 #endif /* __CAST_H__ */
@@ -21,6 +21,8 @@
  * THE SOFTWARE
  */
 
+#include <time.h>
+
 #ifndef _WIN32
 #  include <unistd.h>
 #endif
@@ -280,3 +282,54 @@ void cpthread_ms_to_timespec(struct timespec *ts, unsigned int ms)
     ts->tv_sec = (ms / 1000) + time(NULL);
     ts->tv_nsec = (ms % 1000) * 1000000;
 }
+
+#ifdef _WIN32
+size_t cpthread_atomic_inc(volatile size_t *val)
+{
+#  ifdef _WIN64
+    return (size_t)InterlockedIncrement64((volatile LONG64 *)val);
+#  else
+    return (size_t)InterlockedIncrement((volatile LONG *)val);
+#  endif
+}
+
+size_t cpthread_atomic_dec(volatile size_t *val)
+{
+#  ifdef _WIN64
+    return (size_t)InterlockedDecrement64((volatile LONG64 *)val);
+#  else
+    return (size_t)InterlockedDecrement((volatile LONG *)val);
+#  endif
+}
+#else
+size_t cpthread_atomic_inc(volatile size_t *val)
+{
+    return __atomic_add_fetch(val, 1, __ATOMIC_ACQ_REL);
+}
+
+size_t cpthread_atomic_dec(volatile size_t *val)
+{
+    return __atomic_sub_fetch(val, 1, __ATOMIC_ACQ_REL);
+}
+#endif
+
+#ifdef _WIN32
+uint64_t cpthread_time_ns(void)
+{
+    LARGE_INTEGER freq;
+    LARGE_INTEGER cnt;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return (uint64_t)((double)cnt.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+}
+#else
+uint64_t cpthread_time_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return 0;
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+#endif
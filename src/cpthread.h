@@ -24,6 +24,9 @@
 #ifndef __CPTHREAD_H__
 #define __CPTHREAD_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef _WIN32
 # include <stdbool.h>
 # include <windows.h>
@@ -84,4 +87,11 @@ unsigned int cpthread_get_num_procs();
 
 void cpthread_ms_to_timespec(struct timespec *ts, unsigned int ms);
 
+/* Atomically increment / decrement a counter and return the new value. */
+size_t cpthread_atomic_inc(volatile size_t *val);
+size_t cpthread_atomic_dec(volatile size_t *val);
+
+/* Monotonic clock in nanoseconds. Only useful for measuring intervals. */
+uint64_t cpthread_time_ns(void);
+
 #endif /* __CPTHREAD_H__ */
@@ -0,0 +1,357 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpthread.h"
+#include "dedupe.h"
+#include "htable.h"
+#include "rw_files.h"
+#include "str_builder.h"
+#include "str_helpers.h"
+#include "xmem.h"
+
+/* - - - - */
+
+typedef struct {
+    char    *path;
+    char    *url;  /*!< NULL for content entries. */
+    char    *hash; /*!< NULL if not known. */
+    int64_t  size;
+} dedupe_entry_t;
+
+struct dedupe {
+    char            *filename;
+    htable_t        *urls;   /*!< "size url" -> entry */
+    htable_t        *hashes; /*!< "size hash" -> entry */
+    htable_t        *sizes;  /*!< "size" -> NULL. Sizes that have been added. */
+    bool             dirty;
+    pthread_mutex_t  mutex;
+};
+
+/* - - - - */
+
+static void dedupe_entry_free(void *val)
+{
+    dedupe_entry_t *de = val;
+
+    if (de == NULL)
+        return;
+
+    xfree(de->path);
+    xfree(de->url);
+    xfree(de->hash);
+    xfree(de);
+}
+
+static dedupe_entry_t *dedupe_entry_create(const char *path, int64_t size, const char *url, const char *hash)
+{
+    dedupe_entry_t *de;
+
+    de       = xcalloc(1, sizeof(*de));
+    de->path = xstrdup(path);
+    de->url  = url!=NULL?xstrdup(url):NULL;
+    de->hash = hash!=NULL?xstrdup(hash):NULL;
+    de->size = size;
+    return de;
+}
+
+/* The size is part of the key so a different file that was later
+ * published at the same URL isn't matched. */
+static char *dedupe_key(int64_t size, const char *s)
+{
+    str_builder_t *sb;
+    char           temp[32];
+    char          *out;
+
+    snprintf(temp, sizeof(temp), "%" PRId64, size);
+
+    sb = str_builder_create();
+    str_builder_add_str(sb, temp);
+    if (s != NULL) {
+        str_builder_add_char(sb, ' ');
+        str_builder_add_str(sb, s);
+    }
+    out = str_builder_dump(sb, NULL);
+    str_builder_destroy(sb);
+    return out;
+}
+
+/* Must be called with the lock held. */
+static void dedupe_add_int(dedupe_t *dd, const char *path, int64_t size, const char *url, const char *hash)
+{
+    char *key;
+
+    if (url != NULL) {
+        key = dedupe_key(size, url);
+        htable_insert(dd->urls, key, dedupe_entry_create(path, size, url, hash));
+        xfree(key);
+    }
+
+    if (hash != NULL) {
+        key = dedupe_key(size, hash);
+        htable_insert(dd->hashes, key, dedupe_entry_create(path, size, NULL, hash));
+        xfree(key);
+    }
+
+    key = dedupe_key(size, NULL);
+    htable_insert(dd->sizes, key, NULL);
+    xfree(key);
+}
+
+/* Look up an entry and make sure the file it refers to is still there.
+ * Must be called with the lock held. */
+static dedupe_entry_t *dedupe_find_int(dedupe_t *dd, htable_t *ht, const char *s, int64_t size)
+{
+    dedupe_entry_t *de;
+    char           *key;
+
+    key = dedupe_key(size, s);
+    if (!htable_get(ht, key, (void **)&de)) {
+        xfree(key);
+        return NULL;
+    }
+
+    if (rw_file_size(de->path) != size) {
+        htable_remove(ht, key);
+        dd->dirty = true;
+        de        = NULL;
+    }
+
+    xfree(key);
+    return de;
+}
+
+static void dedupe_load(dedupe_t *dd)
+{
+    char    *data;
+    char    *line;
+    char    *next;
+    char    *fields[4];
+    char    *end;
+    int64_t  size;
+    size_t   i;
+
+    data = (char *)rw_read_file(dd->filename, NULL);
+    if (data == NULL)
+        return;
+
+    /* Lines are "size<tab>hash<tab>path<tab>url". Hash and
+     * URL can be empty. Lines that don't parse are ignored. */
+    for (line=data; line != NULL && *line != '\0'; line=next) {
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        fields[0] = line;
+        for (i=1; i<sizeof(fields)/sizeof(*fields); i++) {
+            fields[i] = strchr(fields[i-1], '\t');
+            if (fields[i] == NULL)
+                break;
+            *fields[i]++ = '\0';
+        }
+        if (i != sizeof(fields)/sizeof(*fields) || str_isempty(fields[2]))
+            continue;
+
+        size = strtoll(fields[0], &end, 10);
+        if (*end != '\0' || size <= 0)
+            continue;
+
+        dedupe_add_int(dd, fields[2], size, str_isempty(fields[3])?NULL:fields[3], str_isempty(fields[1])?NULL:fields[1]);
+    }
+
+    xfree(data);
+}
+
+static bool dedupe_save_cb(const char *key, void *val, void *thunk)
+{
+    dedupe_entry_t *de = val;
+    str_builder_t  *sb = thunk;
+    char            temp[32];
+
+    (void)key;
+
+    snprintf(temp, sizeof(temp), "%" PRId64, de->size);
+    str_builder_add_str(sb, temp);
+    str_builder_add_char(sb, '\t');
+    str_builder_add_str(sb, str_safe(de->hash));
+    str_builder_add_char(sb, '\t');
+    str_builder_add_str(sb, de->path);
+    str_builder_add_char(sb, '\t');
+    str_builder_add_str(sb, str_safe(de->url));
+    str_builder_add_char(sb, '\n');
+    return true;
+}
+
+/* - - - - */
+
+dedupe_t *dedupe_create(const char *filename)
+{
+    dedupe_t *dd;
+
+    if (str_isempty(filename))
+        return NULL;
+
+    dd           = xcalloc(1, sizeof(*dd));
+    dd->filename = xstrdup(filename);
+    dd->urls     = htable_create(dedupe_entry_free);
+    dd->hashes   = htable_create(dedupe_entry_free);
+    dd->sizes    = htable_create(NULL);
+    pthread_mutex_init(&(dd->mutex), NULL);
+
+    dedupe_load(dd);
+    return dd;
+}
+
+void dedupe_destroy(dedupe_t *dd)
+{
+    if (dd == NULL)
+        return;
+
+    htable_destroy(dd->urls);
+    htable_destroy(dd->hashes);
+    htable_destroy(dd->sizes);
+    pthread_mutex_destroy(&(dd->mutex));
+    xfree(dd->filename);
+    xfree(dd);
+}
+
+bool dedupe_save(dedupe_t *dd)
+{
+    str_builder_t *sb;
+    char          *out;
+    size_t         len;
+    bool           ret = true;
+
+    if (dd == NULL)
+        return false;
+
+    pthread_mutex_lock(&(dd->mutex));
+    if (!dd->dirty) {
+        pthread_mutex_unlock(&(dd->mutex));
+        return true;
+    }
+
+    /* Content entries are written even when a URL entry has the same
+     * file. Loading adds them again which is harmless. */
+    sb = str_builder_create();
+    htable_foreach(dd->urls, dedupe_save_cb, sb);
+    htable_foreach(dd->hashes, dedupe_save_cb, sb);
+    dd->dirty = false;
+    pthread_mutex_unlock(&(dd->mutex));
+
+    out = str_builder_dump(sb, &len);
+    str_builder_destroy(sb);
+
+    if (len == 0) {
+        rw_file_unlink(dd->filename);
+    } else {
+        ret = rw_replace_file(dd->filename, (const unsigned char *)out, len);
+    }
+
+    xfree(out);
+    return ret;
+}
+
+char *dedupe_find_url(dedupe_t *dd, const char *url, int64_t size, char **hash)
+{
+    dedupe_entry_t *de;
+    char           *path = NULL;
+
+    if (hash != NULL)
+        *hash = NULL;
+
+    if (dd == NULL || str_isempty(url) || size <= 0)
+        return NULL;
+
+    pthread_mutex_lock(&(dd->mutex));
+    de = dedupe_find_int(dd, dd->urls, url, size);
+    if (de != NULL) {
+        path = xstrdup(de->path);
+        if (hash != NULL && de->hash != NULL) {
+            *hash = xstrdup(de->hash);
+        }
+    }
+    pthread_mutex_unlock(&(dd->mutex));
+
+    return path;
+}
+
+char *dedupe_find_hash(dedupe_t *dd, const char *hash, int64_t size)
+{
+    dedupe_entry_t *de;
+    char           *path = NULL;
+
+    if (dd == NULL || str_isempty(hash) || size <= 0)
+        return NULL;
+
+    pthread_mutex_lock(&(dd->mutex));
+    de = dedupe_find_int(dd, dd->hashes, hash, size);
+    if (de != NULL)
+        path = xstrdup(de->path);
+    pthread_mutex_unlock(&(dd->mutex));
+
+    return path;
+}
+
+bool dedupe_has_size(dedupe_t *dd, int64_t size)
+{
+    char *key;
+    bool  ret;
+
+    if (dd == NULL || size <= 0)
+        return false;
+
+    key = dedupe_key(size, NULL);
+    pthread_mutex_lock(&(dd->mutex));
+    ret = htable_get(dd->sizes, key, NULL);
+    pthread_mutex_unlock(&(dd->mutex));
+    xfree(key);
+
+    return ret;
+}
+
+void dedupe_add(dedupe_t *dd, const char *path, int64_t size, const char *url, const char *hash)
+{
+    if (dd == NULL || str_isempty(path) || size <= 0)
+        return;
+
+    if (str_isempty(url))
+        url = NULL;
+    if (str_isempty(hash))
+        hash = NULL;
+    if (url == NULL && hash == NULL)
+        return;
+
+    /* Values can't have the characters that separate them in the index file. */
+    if (strpbrk(path, "\t\n") != NULL || (url != NULL && strpbrk(url, "\t\n") != NULL))
+        return;
+
+    pthread_mutex_lock(&(dd->mutex));
+    dedupe_add_int(dd, path, size, url, hash);
+    dd->dirty = true;
+    pthread_mutex_unlock(&(dd->mutex));
+}
@@ -0,0 +1,116 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __DEDUPE_H__
+#define __DEDUPE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! \addtogroup dedupe Download Dedupe Index
+ *
+ * Index of downloaded episodes so the same file published in more than
+ * one feed is only downloaded once. Files are found by the URL they were
+ * downloaded from plus their size, or by the SHA-256 of their content.
+ *
+ * Entries are checked against the file system when they're looked up and
+ * dropped if the file was removed or changed size.
+ *
+ * Thread safe.
+ *
+ * @{
+ */
+
+struct dedupe;
+typedef struct dedupe dedupe_t;
+
+/* - - - - */
+
+/*! Create an index.
+ *
+ * \param[in] filename File the index is loaded from and saved to.
+ *
+ * \return Index. Empty if the file doesn't exist.
+ */
+dedupe_t *dedupe_create(const char *filename);
+
+/*! Destroy an index. Changes are not saved.
+ *
+ * \param[in,out] dd Index.
+ */
+void dedupe_destroy(dedupe_t *dd);
+
+/*! Save the index if it has changed.
+ *
+ * \param[in,out] dd Index.
+ *
+ * \return true on success, otherwise false.
+ */
+bool dedupe_save(dedupe_t *dd);
+
+/*! Find a file by where it was downloaded from.
+ *
+ * \param[in,out] dd   Index.
+ * \param[in]     url  URL the file was downloaded from.
+ * \param[in]     size Size of the file.
+ * \param[out]    hash Hex SHA-256 of the file. NULL if it isn't known. Can be NULL.
+ *
+ * \return Path to the file. NULL if not found.
+ */
+char *dedupe_find_url(dedupe_t *dd, const char *url, int64_t size, char **hash);
+
+/*! Find a file by its content.
+ *
+ * \param[in,out] dd   Index.
+ * \param[in]     hash Hex SHA-256 of the file.
+ * \param[in]     size Size of the file.
+ *
+ * \return Path to the file. NULL if not found.
+ */
+char *dedupe_find_hash(dedupe_t *dd, const char *hash, int64_t size);
+
+/*! Check if any file of a given size is known.
+ *
+ * Cheap check used to avoid resolving a URL when nothing could match.
+ *
+ * \param[in] dd   Index.
+ * \param[in] size Size of the file.
+ *
+ * \return true if a file of this size might be in the index.
+ */
+bool dedupe_has_size(dedupe_t *dd, int64_t size);
+
+/*! Add a file.
+ *
+ * \param[in,out] dd   Index.
+ * \param[in]     path Path to the file.
+ * \param[in]     size Size of the file.
+ * \param[in]     url  URL the file was downloaded from. Can be NULL.
+ * \param[in]     hash Hex SHA-256 of the file. Can be NULL.
+ */
+void dedupe_add(dedupe_t *dd, const char *path, int64_t size, const char *url, const char *hash);
+
+/*! @}
+ */
+
+#endif /* __DEDUPE_H__ */
@@ -0,0 +1,316 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+/* dirfd and fstatat. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "cpthread.h"
+#include "dir_index.h"
+#include "htable.h"
+#include "rw_files.h"
+#include "str_helpers.h"
+#include "xarena.h"
+#include "xmem.h"
+
+/* - - - - */
+
+/* Size isn't known until the file is looked up. Only partial downloads
+ * need a size so only they are stat'd while reading the directory. */
+#define DIR_INDEX_SIZE_UNKNOWN -2
+
+/* Directories are kept open after they're released until this many are open. */
+#define DIR_INDEX_MAX_FDS 64
+
+static const char *dir_index_part_ext = ".part";
+
+/*! A file in a directory. Allocated from the directory's arena. */
+typedef struct {
+    int64_t size;
+} dir_index_file_t;
+
+/*! A directory. Files are only read once per directory and reading
+ * happens under the directory's lock so other directories can be
+ * used at the same time. */
+typedef struct {
+    htable_t        *files;  /*!< name -> dir_index_file_t */
+    xarena_t        *arena;
+    pthread_mutex_t  mutex;
+    int              fd;     /*!< Open directory. -1 if not open. */
+    size_t           users;  /*!< Holders of fd. */
+    bool             read;   /*!< Files have been read from disk. */
+} dir_index_dir_t;
+
+struct dir_index {
+    htable_t        *dirs;   /*!< path -> dir_index_dir_t */
+    pthread_mutex_t  mutex;  /*!< Protects dirs. */
+    volatile size_t  fd_cnt; /*!< Directories open. */
+};
+
+/* - - - - */
+
+static void dir_index_dir_destroy(void *val)
+{
+    dir_index_dir_t *d = val;
+
+    if (d == NULL)
+        return;
+
+    if (d->fd >= 0)
+        close(d->fd);
+    htable_destroy(d->files);
+    xarena_release(d->arena);
+    pthread_mutex_destroy(&(d->mutex));
+    xfree(d);
+}
+
+static dir_index_dir_t *dir_index_get_dir(dir_index_t *di, const char *dir)
+{
+    dir_index_dir_t *d = NULL;
+
+    pthread_mutex_lock(&(di->mutex));
+    if (!htable_get(di->dirs, dir, (void **)&d)) {
+        d        = xcalloc(1, sizeof(*d));
+        d->files = htable_create(NULL);
+        d->arena = xarena_create(0);
+        d->fd    = -1;
+        pthread_mutex_init(&(d->mutex), NULL);
+        htable_insert(di->dirs, dir, d);
+    }
+    pthread_mutex_unlock(&(di->mutex));
+
+    return d;
+}
+
+static void dir_index_dir_set(dir_index_dir_t *d, const char *name, int64_t size)
+{
+    dir_index_file_t *f;
+
+    if (htable_get(d->files, name, (void **)&f)) {
+        f->size = size;
+        return;
+    }
+
+    f       = xarena_alloc(d->arena, sizeof(*f));
+    f->size = size;
+    htable_insert(d->files, name, f);
+}
+
+static bool dir_index_is_part(const char *name)
+{
+    size_t len     = strlen(name);
+    size_t ext_len = strlen(dir_index_part_ext);
+
+    return len > ext_len && strcmp(name+len-ext_len, dir_index_part_ext) == 0;
+}
+
+/* Must be called with the directory locked. A directory that doesn't
+ * exist (yet) is empty. */
+static void dir_index_dir_read(dir_index_dir_t *d, const char *dir)
+{
+    DIR           *dh;
+    struct dirent *de;
+    struct stat    st;
+    int64_t        size;
+    bool           need_stat;
+
+    d->read = true;
+
+    dh = opendir(dir);
+    if (dh == NULL)
+        return;
+
+    while ((de = readdir(dh)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+
+        size      = DIR_INDEX_SIZE_UNKNOWN;
+        need_stat = true;
+#ifdef DT_DIR
+        if (de->d_type == DT_DIR)
+            continue;
+        /* Not all file systems report the type. */
+        need_stat = de->d_type == DT_UNKNOWN || de->d_type == DT_LNK || dir_index_is_part(de->d_name);
+#endif
+
+        if (need_stat) {
+            if (fstatat(dirfd(dh), de->d_name, &st, 0) != 0 || S_ISDIR(st.st_mode))
+                continue;
+            size = (int64_t)st.st_size;
+        }
+
+        dir_index_dir_set(d, de->d_name, size);
+    }
+
+    closedir(dh);
+}
+
+/* - - - - */
+
+dir_index_t *dir_index_create(void)
+{
+    dir_index_t *di;
+
+    di       = xcalloc(1, sizeof(*di));
+    di->dirs = htable_create(dir_index_dir_destroy);
+    pthread_mutex_init(&(di->mutex), NULL);
+
+    return di;
+}
+
+void dir_index_destroy(dir_index_t *di)
+{
+    if (di == NULL)
+        return;
+
+    htable_destroy(di->dirs);
+    pthread_mutex_destroy(&(di->mutex));
+    xfree(di);
+}
+
+int64_t dir_index_lookup(dir_index_t *di, const char *dir, const char *name)
+{
+    dir_index_dir_t  *d;
+    dir_index_file_t *f;
+    char             *path;
+    int64_t           size = -1;
+
+    if (di == NULL || str_isempty(dir) || str_isempty(name))
+        return -1;
+
+    d = dir_index_get_dir(di, dir);
+
+    pthread_mutex_lock(&(d->mutex));
+    if (!d->read)
+        dir_index_dir_read(d, dir);
+
+    if (htable_get(d->files, name, (void **)&f)) {
+        if (f->size == DIR_INDEX_SIZE_UNKNOWN) {
+            if (d->fd >= 0) {
+                f->size = rw_file_size_at(d->fd, name);
+            } else {
+                path    = rw_join_path(2, dir, name);
+                f->size = rw_file_size(path);
+                xfree(path);
+            }
+        }
+        size = f->size;
+    }
+    pthread_mutex_unlock(&(d->mutex));
+
+    return size;
+}
+
+bool dir_index_exists(dir_index_t *di, const char *dir, const char *name)
+{
+    dir_index_dir_t *d;
+    bool             ret;
+
+    if (di == NULL || str_isempty(dir) || str_isempty(name))
+        return false;
+
+    d = dir_index_get_dir(di, dir);
+
+    pthread_mutex_lock(&(d->mutex));
+    if (!d->read)
+        dir_index_dir_read(d, dir);
+    /* Only whether it's there matters so a size that
+     * isn't known yet can stay that way. */
+    ret = htable_get(d->files, name, NULL);
+    pthread_mutex_unlock(&(d->mutex));
+
+    return ret;
+}
+
+void dir_index_update(dir_index_t *di, const char *dir, const char *name, int64_t size)
+{
+    dir_index_dir_t *d;
+
+    if (di == NULL || str_isempty(dir) || str_isempty(name))
+        return;
+
+    d = dir_index_get_dir(di, dir);
+
+    pthread_mutex_lock(&(d->mutex));
+    if (size < 0) {
+        htable_remove(d->files, name);
+    } else {
+        dir_index_dir_set(d, name, size);
+    }
+    pthread_mutex_unlock(&(d->mutex));
+}
+
+int dir_index_dir_acquire(dir_index_t *di, const char *dir, bool create)
+{
+    dir_index_dir_t *d;
+    int              fd;
+
+    if (di == NULL || str_isempty(dir))
+        return -1;
+
+    d = dir_index_get_dir(di, dir);
+
+    pthread_mutex_lock(&(d->mutex));
+    if (d->fd < 0) {
+        d->fd = rw_dir_open(dir);
+        if (d->fd < 0 && create && rw_create_dir(dir))
+            d->fd = rw_dir_open(dir);
+        if (d->fd >= 0)
+            cpthread_atomic_inc(&(di->fd_cnt));
+    }
+    fd = d->fd;
+    if (fd >= 0)
+        d->users++;
+    pthread_mutex_unlock(&(d->mutex));
+
+    return fd;
+}
+
+void dir_index_dir_release(dir_index_t *di, const char *dir)
+{
+    dir_index_dir_t *d;
+
+    if (di == NULL || str_isempty(dir))
+        return;
+
+    d = dir_index_get_dir(di, dir);
+
+    pthread_mutex_lock(&(d->mutex));
+    if (d->users > 0)
+        d->users--;
+    /* Keep directories open up to a limit so a run over thousands of
+     * casts doesn't run out of descriptors. */
+    if (d->users == 0 && d->fd >= 0 && di->fd_cnt > DIR_INDEX_MAX_FDS) {
+        close(d->fd);
+        d->fd = -1;
+        cpthread_atomic_dec(&(di->fd_cnt));
+    }
+    pthread_mutex_unlock(&(d->mutex));
+}
@@ -0,0 +1,120 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __DIR_INDEX_H__
+#define __DIR_INDEX_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! \addtogroup dir_index Directory Index
+ *
+ * In memory index of the files in download directories. Each directory
+ * is read once, the first time a file in it is looked up, instead of
+ * probing the file system for every file.
+ *
+ * Directories can also be opened through the index. Open directories
+ * are kept open so files in them can be worked on relative to the
+ * directory instead of resolving the full path every time.
+ *
+ * The index only knows about changes made through it. Files created or
+ * removed by something else after a directory has been read are not seen.
+ *
+ * Thread safe.
+ *
+ * @{
+ */
+
+struct dir_index;
+typedef struct dir_index dir_index_t;
+
+/* - - - - */
+
+/*! Create a directory index.
+ *
+ * \return Index.
+ */
+dir_index_t *dir_index_create(void);
+
+/*! Destroy a directory index.
+ *
+ * \param[in,out] di Index.
+ */
+void dir_index_destroy(dir_index_t *di);
+
+/*! Look up a file.
+ *
+ * \param[in,out] di   Index.
+ * \param[in]     dir  Path to the directory.
+ * \param[in]     name Name of the file in the directory.
+ *
+ * \return Size of the file. -1 if the file does not exist.
+ */
+int64_t dir_index_lookup(dir_index_t *di, const char *dir, const char *name);
+
+/*! Check if a file exists.
+ *
+ * Unlike dir_index_lookup the file is never stat'd. Whether it exists
+ * is known from reading the directory.
+ *
+ * \param[in,out] di   Index.
+ * \param[in]     dir  Path to the directory.
+ * \param[in]     name Name of the file in the directory.
+ *
+ * \return true if the file exists.
+ */
+bool dir_index_exists(dir_index_t *di, const char *dir, const char *name);
+
+/*! Record a change to a file.
+ *
+ * \param[in,out] di   Index.
+ * \param[in]     dir  Path to the directory.
+ * \param[in]     name Name of the file in the directory.
+ * \param[in]     size Size of the file. Negative if the file was removed.
+ */
+void dir_index_update(dir_index_t *di, const char *dir, const char *name, int64_t size);
+
+/*! Open a directory.
+ *
+ * The directory stays open until released. It's kept open after being
+ * released unless too many directories are open.
+ *
+ * \param[in,out] di     Index.
+ * \param[in]     dir    Path to the directory.
+ * \param[in]     create Create the directory (and parents) if it doesn't exist.
+ *
+ * \return Descriptor for the directory. -1 on error. Must not be closed.
+ */
+int dir_index_dir_acquire(dir_index_t *di, const char *dir, bool create);
+
+/*! Release a directory opened with dir_index_dir_acquire.
+ *
+ * \param[in,out] di  Index.
+ * \param[in]     dir Path to the directory.
+ */
+void dir_index_dir_release(dir_index_t *di, const char *dir);
+
+/*! @}
+ */
+
+#endif /* __DIR_INDEX_H__ */
@@ -21,7 +21,7 @@
  * THE SOFTWARE
  */
 
-#include <fcntl.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <string.h>
 #include <sys/types.h>
@@ -34,8 +34,15 @@
 #include <curl/curl.h>
 
 #include "cast.h"
+#include "dedupe.h"
+#include "dir_index.h"
+#include "ep_store.h"
+#include "feed_sched.h"
+#include "feed_state.h"
+#include "part_state.h"
 #include "downloader.h"
 #include "settings.h"
+#include "sha256.h"
 #include "str_builder.h"
 #include "str_helpers.h"
 #include "rw_files.h"
@@ -46,10 +53,19 @@
 
 #define PD_USERAGENT "PodDown 1.0.0"
 
-tpool_t *feed_pool    = NULL;
-tpool_t *dlep_pool    = NULL;
-time_t   lastdl       = 0;
-bool     was_dl_error = false;
+tpool_t          *feed_pool     = NULL;
+tpool_t          *dlep_pool     = NULL;
+tpool_t          *finalize_pool = NULL;
+tpool_t          *probe_pool    = NULL;
+writebehind_t    *ep_writer     = NULL;
+admission_t      *ep_admission  = NULL;
+dir_index_t      *ep_dir_index  = NULL;
+dedupe_t         *ep_dedupe     = NULL;
+ep_store_t       *ep_states     = NULL;
+feed_state_t     *feed_states   = NULL;
+redirect_cache_t *ep_redirects  = NULL;
+time_t            lastdl        = 0;
+bool              was_dl_error  = false;
 
 /* - - - - */
 
@@ -75,16 +91,76 @@ static CURL *generic_curl_base(const char *url)
     return curl;
 }
 
-static CURLcode do_download(const char *url, curl_write_callback wcb, void *thunk, int64_t resumesize, char *error, size_t errlen)
+/* Whether a request to a cached redirect failed because the redirect
+ * is no longer any good. Anything else, like a range or resume error,
+ * would happen with the original URL too and is for the caller. */
+static bool episode_redirect_stale(CURLcode res)
+{
+    switch (res) {
+        case CURLE_HTTP_RETURNED_ERROR:
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_SSL_CONNECT_ERROR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Perform a request for an episode URL. If it redirected before the
+ * request goes straight to where it ended up. Those URLs are often
+ * signed and expire so the original URL is used when the server
+ * refuses it or can't be reached. */
+static CURLcode episode_perform(CURL *curl, const char *url)
 {
-    CURL     *curl;
     CURLcode  res;
+    char     *cached;
+    char     *effective = NULL;
+    long      code      = 0;
+
+    cached = redirect_cache_get(ep_redirects, url);
+    if (cached != NULL) {
+        curl_easy_setopt(curl, CURLOPT_URL, cached);
+        /* An error page isn't passed on so it can't end up in the file. */
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
+        res = curl_easy_perform(curl);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 0);
+        xfree(cached);
+
+        if (!episode_redirect_stale(res))
+            return res;
+
+        redirect_cache_remove(ep_redirects, url);
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+    }
+
+    res = curl_easy_perform(curl);
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        if (code < 400 && curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective) == CURLE_OK)
+            redirect_cache_put(ep_redirects, url, effective);
+    }
+    return res;
+}
+
+/* if_range is sent with a resumed download so the server sends the whole
+ * file instead of the rest if it's changed. libcurl fails with
+ * CURLE_RANGE_ERROR when that happens, before any data is received. */
+static CURLcode do_download(const char *url, curl_write_callback wcb, curl_write_callback hcb, void *thunk,
+        int64_t resumesize, const char *if_range, char **final_url, char *error, size_t errlen)
+{
+    CURL              *curl;
+    struct curl_slist *headers   = NULL;
+    str_builder_t     *sb;
+    char              *header;
+    CURLcode           res;
+    char              *effective;
     /* CURL requires the error buffer to be at least it's
      * specified size. Instead of putting that requirement
      * on the caller we store the error in this buffer then
      * if an error variable was passed into the function we'll
      * fill it with the contents on this buffer on error. */
-    char      myerror[CURL_ERROR_SIZE] = { 0 };
+    char               myerror[CURL_ERROR_SIZE] = { 0 };
 
     curl = generic_curl_base(url);
     if (curl == NULL) {
@@ -97,109 +173,851 @@ static CURLcode do_download(const char *url, curl_write_callback wcb, void *thun
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, wcb);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, thunk);
     curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, myerror);
+    if (hcb != NULL) {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, hcb);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, thunk);
+    }
 
-    if (resumesize > 0)
-        curl_easy_setopt(curl, CURLOPT_RESUME_FROM, resumesize);
+    if (resumesize > 0) {
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)resumesize);
+        if (!str_isempty(if_range)) {
+            sb = str_builder_create();
+            str_builder_add_str(sb, "If-Range: ");
+            str_builder_add_str(sb, if_range);
+            header  = str_builder_dump(sb, NULL);
+            headers = curl_slist_append(headers, header);
+            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+            xfree(header);
+            str_builder_destroy(sb);
+        }
+    }
 
-    res = curl_easy_perform(curl);
+    res = episode_perform(curl, url);
     if (res != CURLE_OK && error != NULL && errlen > 0)
         snprintf(error, errlen, "%s", myerror);
 
+    /* Where the data actually came from after following redirects. */
+    if (final_url != NULL) {
+        *final_url = NULL;
+        if (res == CURLE_OK && curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective) == CURLE_OK && effective != NULL)
+            *final_url = xstrdup(effective);
+    }
+
     curl_easy_cleanup(curl);
+    curl_slist_free_all(headers);
     return res;
 }
 
-/* Save some bandwidth by checking if the file's changed.
- * If it hasn't there isn't any need to download it again. */
-static bool url_has_changed(const char *url)
+/* Key for an episode in the state store. */
+static ep_store_key_t episode_key(const cast_ep_t *cast_ep)
 {
-    CURL     *curl;
-    CURLcode  res;
-    /* Negative filetime is used to indicate an error in pulling the file time
-     * which will be treated as the url has changed since last time. */
-    long      filetime = -1;
+    return ep_store_key(cast_key(cast_ep_cast(cast_ep)), cast_ep_id(cast_ep));
+}
 
-    /* First run the lastdl time is 0. There is not need
-     * to check if the url has changed because it's new to us. */
-    if (lastdl == 0)
-        return true;
+/* A feed being downloaded. */
+typedef struct {
+    str_builder_t *sb;
+    sha256_t      *hash;  /*!< Hash of the body with whitespace collapsed. */
+    bool           space; /*!< Last character hashed was whitespace. */
+} feed_body_t;
 
-    if (settings->ignore_last_modified)
-        return true;
+static bool feed_isspace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
 
-    curl = generic_curl_base(url);
-    if (curl == NULL)
-        return true;
+/* Callback for writing downloaded cast feed (XML) data to a buffer.
+ *
+ * The body is hashed as it arrives so a feed that hasn't changed can be
+ * recognized without another pass over it. Runs of whitespace are
+ * hashed as a single space so reformatting alone doesn't count as a
+ * change. */
+static size_t feed_dl_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    feed_body_t *body = userdata;
+    size_t       len  = size*nmemb;
+    size_t       start;
+    size_t       i;
+
+    str_builder_add_sub_str(body->sb, ptr, len);
+
+    for (start=0, i=0; i<len; i++) {
+        if (!feed_isspace(ptr[i]))
+            continue;
+        if (i > start) {
+            sha256_update(body->hash, ptr+start, i-start);
+            body->space = false;
+        }
+        if (!body->space) {
+            sha256_update(body->hash, " ", 1);
+            body->space = true;
+        }
+        start = i+1;
+    }
+    if (len > start) {
+        sha256_update(body->hash, ptr+start, len-start);
+        body->space = false;
+    }
+    return len;
+}
 
-    /* Check 304 last modified time to determine if we need to
-     * download the file. */
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 1);
-    curl_easy_setopt(curl, CURLOPT_FILETIME, 1);
+/* Get the value of a header line if it's the named header. */
+static char *header_value(const char *line, size_t len, const char *name)
+{
+    char   *out;
+    size_t  nlen = strlen(name);
 
-    res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        curl_easy_cleanup(curl);
-        return true;
+    if (len <= nlen || strncasecmp(line, name, nlen) != 0 || line[nlen] != ':')
+        return NULL;
+
+    line += nlen+1;
+    len  -= nlen+1;
+    while (len > 0 && (*line == ' ' || *line == '\t')) {
+        line++;
+        len--;
     }
+    while (len > 0 && (line[len-1] == '\r' || line[len-1] == '\n' || line[len-1] == ' '))
+        len--;
+    if (len == 0)
+        return NULL;
 
-    res = curl_easy_getinfo(curl, CURLINFO_FILETIME, &filetime);
-    if (res != CURLE_OK)
-        filetime = -1;
+    out = xmalloc(len+1);
+    memcpy(out, line, len);
+    out[len] = '\0';
+    return out;
+}
 
-    curl_easy_cleanup(curl);
+/* What a HEAD request says about an episode. */
+typedef struct {
+    int64_t  size;      /*!< -1 if not known. */
+    long     filetime;  /*!< -1 if not known. */
+    char    *final_url; /*!< Where the URL redirects to. NULL if not known. */
+    bool     resumable; /*!< false if the server said it doesn't accept ranges. */
+} ep_probe_t;
 
-    if (filetime > 0 && filetime < lastdl)
-        return false;
-    return true;
+static size_t probe_header_cb(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    ep_probe_t *probe = userdata;
+    size_t      len   = size*nitems;
+    char       *val;
+
+    /* Only the final response counts. Redirects have their own. */
+    if (len > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        probe->resumable = true;
+        return len;
+    }
+
+    if ((val = header_value(buffer, len, "Accept-Ranges")) != NULL) {
+        probe->resumable = strcasecmp(val, "none") != 0;
+        xfree(val);
+    }
+    return len;
 }
 
-static int64_t remote_filesize(const char *url)
+/* Get everything needed about an episode before downloading it with
+ * a single request. Following the redirects also fills the redirect
+ * cache so the download goes straight to the file. */
+static void remote_probe(const char *url, ep_probe_t *probe)
 {
-    CURL     *curl;
-    CURLcode  res;
-    long      filesize = -1;
+    CURL       *curl;
+    CURLcode    res;
+    curl_off_t  len       = -1;
+    long        filetime  = -1;
+    long        code      = 0;
+    char       *effective = NULL;
+
+    probe->size      = -1;
+    probe->filetime  = -1;
+    probe->final_url = NULL;
+    probe->resumable = true;
 
     curl = generic_curl_base(url);
     if (curl == NULL)
-        return -1;
+        return;
 
     /* Disable accepting encoding (compression) because we want the real file
      * size. If this is set then the server *should* respond with the size of
      * the compressed data. We want the size of the uncompressed data. */
-    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, NULL); 
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, NULL);
     curl_easy_setopt(curl, CURLOPT_NOBODY, 1);
+    curl_easy_setopt(curl, CURLOPT_FILETIME, 1);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, probe_header_cb);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, probe);
+
+    res = episode_perform(curl, url);
+    if (res == CURLE_OK)
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+
+    /* The size of an error page isn't the size of the episode. */
+    if (res == CURLE_OK && code < 400) {
+        if (curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &len) == CURLE_OK && len > 0)
+            probe->size = (int64_t)len;
+        if (curl_easy_getinfo(curl, CURLINFO_FILETIME, &filetime) == CURLE_OK)
+            probe->filetime = filetime;
+        if (curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effective) == CURLE_OK && effective != NULL)
+            probe->final_url = xstrdup(effective);
+    } else {
+        probe->resumable = true;
+    }
 
-    res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        curl_easy_cleanup(curl);
-        return -1;
+    curl_easy_cleanup(curl);
+}
+
+/* Callback for collecting the validators of a feed and how long it can
+ * be cached from the response headers. Only the final response counts.
+ * Redirects have their own. */
+static size_t feed_header_cb(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    feed_info_t *info = userdata;
+    size_t       len  = size*nitems;
+    char        *val;
+    char        *p;
+    time_t       t;
+
+    if (len > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        xfree(info->etag);
+        xfree(info->last_modified);
+        info->etag          = NULL;
+        info->last_modified = NULL;
+        info->max_age       = 0;
+        return len;
+    }
+
+    if ((val = header_value(buffer, len, "ETag")) != NULL) {
+        xfree(info->etag);
+        info->etag = val;
+    } else if ((val = header_value(buffer, len, "Last-Modified")) != NULL) {
+        xfree(info->last_modified);
+        info->last_modified = val;
+    } else if ((val = header_value(buffer, len, "Cache-Control")) != NULL) {
+        /* Takes priority over Expires. Other directives
+         * don't say anything about how long it can be kept. */
+        p = strstr(val, "max-age=");
+        if (p != NULL)
+            info->max_age = strtoll(p+8, NULL, 10);
+        xfree(val);
+    } else if ((val = header_value(buffer, len, "Expires")) != NULL) {
+        t = curl_getdate(val, NULL);
+        if (info->max_age == 0 && t > 0)
+            info->max_age = (int64_t)(t - time(NULL));
+        xfree(val);
+    }
+    if (info->max_age < 0)
+        info->max_age = 0;
+    return len;
+}
+
+/* Download a feed only if it's changed since it was last checked. The
+ * validators from the last check are sent so the server can answer
+ * with "304 Not Modified" instead of the feed. That saves a separate
+ * request to find out if it's changed.
+ *
+ * Unless conditional is set the feed is always downloaded. resp gets
+ * the validators sent back with the feed. notmodified is set when the
+ * feed hasn't changed and the body is left empty. */
+static CURLcode feed_download(const char *url, feed_body_t *body, const feed_info_t *info, bool conditional, time_t since,
+        feed_info_t *resp, bool *notmodified, char *error, size_t errlen)
+{
+    CURL              *curl;
+    struct curl_slist *headers                  = NULL;
+    str_builder_t     *hsb;
+    char              *header;
+    CURLcode           res;
+    long               code                     = 0;
+    long               unmet                    = 0;
+    char               myerror[CURL_ERROR_SIZE] = { 0 };
+
+    *notmodified = false;
+
+    curl = generic_curl_base(url);
+    if (curl == NULL) {
+        snprintf(error, errlen, "Failed to initialize CURL");
+        return CURLE_FAILED_INIT;
     }
 
-    res = curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &filesize);
-    if (res != CURLE_OK)
-        filesize = -1;
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, feed_dl_cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, body);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, feed_header_cb);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, resp);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, myerror);
+    /* An error page is not a feed. */
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
+
+    if (conditional) {
+        hsb = str_builder_create();
+        if (info->etag != NULL) {
+            str_builder_add_str(hsb, "If-None-Match: ");
+            str_builder_add_str(hsb, info->etag);
+            header  = str_builder_dump(hsb, NULL);
+            headers = curl_slist_append(headers, header);
+            xfree(header);
+            str_builder_clear(hsb);
+        }
+        if (info->last_modified != NULL) {
+            str_builder_add_str(hsb, "If-Modified-Since: ");
+            str_builder_add_str(hsb, info->last_modified);
+            header  = str_builder_dump(hsb, NULL);
+            headers = curl_slist_append(headers, header);
+            xfree(header);
+        } else if (info->etag == NULL && since > 0) {
+            /* Nothing from the server to go on so ask
+             * if it's changed since it was last checked. */
+            curl_easy_setopt(curl, CURLOPT_TIMECONDITION, CURL_TIMECOND_IFMODSINCE);
+            curl_easy_setopt(curl, CURLOPT_TIMEVALUE, (long)since);
+        }
+        str_builder_destroy(hsb);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+
+    res = curl_easy_perform(curl);
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        curl_easy_getinfo(curl, CURLINFO_CONDITION_UNMET, &unmet);
+        if (code == 304 || unmet) {
+            *notmodified = true;
+            str_builder_clear(body->sb);
+        }
+    } else {
+        snprintf(error, errlen, "%s", myerror);
+    }
 
     curl_easy_cleanup(curl);
-    return filesize;
+    curl_slist_free_all(headers);
+    return res;
 }
 
-/* Callback for writing downloaded cast feed (XML) data to a buffer. */
-static size_t feed_dl_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
+/* How much of the end of a partial download is requested again and
+ * compared when verify_resume_tail is enabled. */
+#define EP_RESUME_TAIL (16*1024)
+
+/* Where episode data being received goes. */
+typedef struct {
+    wb_file_t     *wf;
+    sha256_t      *hash;          /*!< NULL when not hashing. */
+    unsigned char *tail;          /*!< End of the partial file the data must start with. NULL when not verifying. */
+    size_t         tail_len;
+    size_t         tail_pos;      /*!< How much of the tail has been matched. */
+    bool           mismatch;      /*!< The data didn't match the partial file. */
+    char          *etag;          /*!< ETag of the response. */
+    char          *last_modified; /*!< Last-Modified of the response. */
+} ep_dl_t;
+
+/* Callback for writing cast episode data to a file. The data is handed
+ * to the write behind pool so a slow disk doesn't hold up receiving. It's
+ * hashed as it arrives so the file never has to be read back. */
+static size_t episode_dl_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
 {
-    str_builder_t *sb = userdata;
-    str_builder_add_sub_str(sb, ptr, size*nmemb);
+    ep_dl_t *dl  = userdata;
+    size_t   len = size*nmemb;
+    size_t   n;
+
+    /* The overlap with the partial file is checked
+     * and dropped. It's already in the file. */
+    if (dl->tail_pos < dl->tail_len) {
+        n = dl->tail_len-dl->tail_pos;
+        if (n > len)
+            n = len;
+        if (memcmp(dl->tail+dl->tail_pos, ptr, n) != 0) {
+            dl->mismatch = true;
+            return 0;
+        }
+        dl->tail_pos += n;
+        ptr          += n;
+        len          -= n;
+        if (len == 0)
+            return size*nmemb;
+    }
+
+    if (!wb_file_write(dl->wf, ptr, len))
+        return 0;
+    sha256_update(dl->hash, ptr, len);
     return size*nmemb;
 }
 
-/* Callback for writing cast episode data to a file. */
-static size_t episode_dl_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
+/* Callback for collecting the validators of an episode so
+ * a partial download can be resumed safely. */
+static size_t episode_header_cb(char *buffer, size_t size, size_t nitems, void *userdata)
 {
-    FILE   *f = userdata;
-    size_t  r;
-    r = fwrite(ptr, size, nmemb, f);
-    if (r == 0)
-        return 0;
-    return r;
+    ep_dl_t *dl  = userdata;
+    size_t   len = size*nitems;
+    char    *val;
+
+    /* Only the final response counts. Redirects have their own. */
+    if (len > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        xfree(dl->etag);
+        xfree(dl->last_modified);
+        dl->etag          = NULL;
+        dl->last_modified = NULL;
+        return len;
+    }
+
+    if ((val = header_value(buffer, len, "ETag")) != NULL) {
+        xfree(dl->etag);
+        dl->etag = val;
+    } else if ((val = header_value(buffer, len, "Last-Modified")) != NULL) {
+        xfree(dl->last_modified);
+        dl->last_modified = val;
+    }
+    return len;
+}
+
+/* Value to send in If-Range to resume a partial download. Weak ETags
+ * can't be used for ranges. NULL if the partial download can't be
+ * safely resumed. */
+static const char *episode_if_range(const part_state_t *ps)
+{
+    const char *val;
+
+    val = part_state_get(ps, "etag");
+    if (!str_isempty(val) && strncmp(val, "W/", 2) != 0)
+        return val;
+
+    val = part_state_get(ps, "last_modified");
+    if (!str_isempty(val))
+        return val;
+    return NULL;
+}
+
+/* Read the end of a partial download to compare with what the server sends. */
+static unsigned char *episode_read_tail(int partfd, const char *filename_dl, int64_t filesize, size_t *len)
+{
+    unsigned char *buf;
+    ssize_t        r;
+    size_t         want;
+    size_t         pos  = 0;
+    int            fd;
+
+    *len = 0;
+    want = filesize<EP_RESUME_TAIL?(size_t)filesize:EP_RESUME_TAIL;
+    fd   = rw_file_open_read_at(partfd, filename_dl);
+    if (fd == -1)
+        return NULL;
+
+    buf = xmalloc(want);
+    while (pos < want) {
+        r = pread(fd, buf+pos, want-pos, filesize-(int64_t)want+(int64_t)pos);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        pos += (size_t)r;
+    }
+    close(fd);
+
+    if (pos != want) {
+        xfree(buf);
+        return NULL;
+    }
+
+    *len = want;
+    return buf;
+}
+
+/* Name of the file with the state of a partial download. */
+static char *episode_state_name(const char *filename_dl)
+{
+    str_builder_t *sb;
+    char          *out;
+
+    sb = str_builder_create();
+    str_builder_add_str(sb, filename_dl);
+    str_builder_add_str(sb, ".state");
+    out = str_builder_dump(sb, NULL);
+    str_builder_destroy(sb);
+    return out;
+}
+
+/* Get the hash of the data already downloaded so hashing can continue
+ * when resuming. Uses the saved state when it matches the partial file.
+ * Otherwise the partial file is read and hashed again. */
+static bool episode_hash_resume(sha256_t *hash, const part_state_t *ps, int partfd, const char *filename_dl, int64_t filesize)
+{
+    unsigned char  buf[64*1024];
+    ssize_t        r;
+    int64_t        left;
+    int            fd;
+    bool           ret;
+
+    ret = ps != NULL
+        && part_state_get_int(ps, "offset") == filesize
+        && sha256_state_load(hash, part_state_get(ps, "sha256"))
+        && (int64_t)sha256_len(hash) == filesize;
+    if (ret)
+        return true;
+
+    sha256_reset(hash);
+    fd = rw_file_open_read_at(partfd, filename_dl);
+    if (fd == -1)
+        return false;
+
+    left = filesize;
+    while (left > 0) {
+        r = read(fd, buf, left<(int64_t)sizeof(buf)?(size_t)left:sizeof(buf));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        sha256_update(hash, buf, (size_t)r);
+        left -= r;
+    }
+    close(fd);
+
+    return left == 0;
+}
+
+/* Save what's needed to resume a partial download. Without a validator
+ * it can't be resumed so nothing is saved. The hash is only saved if it
+ * covers exactly the data in the file. */
+static void episode_state_save(int partfd, const char *statename, sha256_t *hash, int64_t filesize,
+        const char *etag, const char *last_modified)
+{
+    part_state_t *ps;
+    char         *state;
+
+    if (str_isempty(etag) && str_isempty(last_modified)) {
+        part_state_remove(partfd, statename);
+        return;
+    }
+
+    ps = part_state_create();
+    part_state_set_int(ps, "offset", filesize);
+    /* Values can't span lines. */
+    if (!str_isempty(etag) && strchr(etag, '\n') == NULL)
+        part_state_set(ps, "etag", etag);
+    if (!str_isempty(last_modified) && strchr(last_modified, '\n') == NULL)
+        part_state_set(ps, "last_modified", last_modified);
+    if (hash != NULL && (int64_t)sha256_len(hash) == filesize) {
+        state = sha256_state_save(hash);
+        part_state_set(ps, "sha256", state);
+        xfree(state);
+    }
+    part_state_save(ps, partfd, statename);
+    part_state_destroy(ps);
+}
+
+/* Write a checksum file next to an episode in the format used by sha256sum. */
+static void episode_write_checksum(int destfd, const char *filename, const char *hex)
+{
+    str_builder_t *sb;
+    char          *name;
+    char          *data;
+    size_t         len;
+
+    if (hex == NULL)
+        return;
+
+    sb = str_builder_create();
+    str_builder_add_str(sb, filename);
+    str_builder_add_str(sb, ".sha256");
+    name = str_builder_dump(sb, NULL);
+    str_builder_clear(sb);
+
+    str_builder_add_str(sb, hex);
+    str_builder_add_str(sb, "  ");
+    str_builder_add_str(sb, filename);
+    str_builder_add_char(sb, '\n');
+    data = str_builder_dump(sb, &len);
+    str_builder_destroy(sb);
+
+    if (!rw_write_file_at(destfd, name, (const unsigned char *)data, len)) {
+        fprintf(stderr, "Could not write checksum file '%s'\n", name);
+        was_dl_error = true;
+    }
+
+    xfree(data);
+    xfree(name);
+}
+
+/* Make a file a copy of an existing one without downloading it again.
+ * Sharing the data with a reflink is tried first, then a hard link. A
+ * real copy is only made if allowed. The copy is made under a temporary
+ * name and renamed so it replaces any existing file in one step. */
+static bool episode_link(const char *src, int destfd, const char *name, bool allow_copy)
+{
+    str_builder_t *sb;
+    char          *tmpname;
+    int            infd;
+    int            outfd = -1;
+    bool           ret   = false;
+
+    infd = rw_file_open_read(src);
+    if (infd == -1)
+        return false;
+
+    sb = str_builder_create();
+    str_builder_add_str(sb, name);
+    str_builder_add_str(sb, ".link");
+    tmpname = str_builder_dump(sb, NULL);
+    str_builder_destroy(sb);
+
+    outfd = rw_file_open_at(destfd, tmpname, true);
+    if (outfd != -1)
+        ret = rw_fd_clone(outfd, infd);
+
+    if (!ret) {
+        if (outfd != -1)
+            close(outfd);
+        outfd = -1;
+        rw_file_unlink_at(destfd, tmpname);
+        ret = rw_link_at(src, destfd, tmpname);
+    }
+
+    if (!ret && allow_copy) {
+        outfd = rw_file_open_at(destfd, tmpname, true);
+        if (outfd != -1)
+            ret = rw_fd_copy(outfd, infd);
+    }
+
+    if (outfd != -1 && close(outfd) != 0)
+        ret = false;
+    close(infd);
+
+    if (ret)
+        ret = rw_rename_at(destfd, tmpname, destfd, name);
+    if (!ret)
+        rw_file_unlink_at(destfd, tmpname);
+
+    xfree(tmpname);
+    return ret;
+}
+
+/* Whether the dedupe index has anything the episode could be a copy of.
+ * If it does episode_dedupe needs to know where the URL redirects to. */
+static bool episode_dedupe_candidate(int64_t expectsize)
+{
+    return ep_dedupe != NULL && expectsize > 0 && dedupe_has_size(ep_dedupe, expectsize);
+}
+
+/* The same episode is often in more than one feed. Look for it in what's
+ * already been downloaded and copy it from there instead. The URL from the
+ * feed is checked first. Feeds tend to wrap the URL in tracking redirects
+ * that differ between feeds, so if any file of the same size is known
+ * where the URL redirects to is checked too. That was found when the
+ * episode was probed so no request is made here. */
+static bool episode_dedupe(const char *url, const char *final_url, const char *dirpath, const char *filename, int64_t expectsize)
+{
+    char *src;
+    char *hash   = NULL;
+    char *cached = NULL;
+    int   destfd;
+    bool  ret    = false;
+
+    if (!episode_dedupe_candidate(expectsize))
+        return false;
+
+    src = dedupe_find_url(ep_dedupe, url, expectsize, &hash);
+    if (src == NULL) {
+        if (final_url == NULL)
+            final_url = cached = redirect_cache_get(ep_redirects, url);
+        if (final_url != NULL && strcmp(final_url, url) != 0)
+            src = dedupe_find_url(ep_dedupe, final_url, expectsize, &hash);
+    }
+    xfree(cached);
+    if (src == NULL)
+        return false;
+
+    /* If this fails the episode is downloaded like normal. */
+    destfd = dir_index_dir_acquire(ep_dir_index, dirpath, true);
+    if (destfd != -1) {
+        ret = episode_link(src, destfd, filename, true);
+        if (ret) {
+            dir_index_update(ep_dir_index, dirpath, filename, expectsize);
+            if (settings->checksums)
+                episode_write_checksum(destfd, filename, hash);
+        }
+        dir_index_dir_release(ep_dir_index, dirpath);
+    }
+
+    xfree(hash);
+    xfree(src);
+    return ret;
+}
+
+/* Add a finished download to the dedupe index. If the same content was
+ * already downloaded for another cast the new file is replaced with a
+ * link to it so the data is only stored once. */
+static void episode_dedupe_record(int destfd, const char *dirpath, const char *filename,
+        const char *url, const char *final_url, const char *hash, int64_t filesize)
+{
+    char *path;
+    char *src;
+
+    if (ep_dedupe == NULL)
+        return;
+
+    path = rw_join_path(2, dirpath, filename);
+    src  = dedupe_find_hash(ep_dedupe, hash, filesize);
+    if (src != NULL && strcmp(src, path) != 0)
+        episode_link(src, destfd, filename, false);
+
+    dedupe_add(ep_dedupe, path, filesize, url, hash);
+    if (final_url != NULL && strcmp(final_url, url) != 0)
+        dedupe_add(ep_dedupe, path, filesize, final_url, hash);
+
+    xfree(src);
+    xfree(path);
+}
+
+/* A finished download that has to be copied to its final location. */
+typedef struct {
+    char           *castname;
+    char           *dirpath;
+    char           *partpath;
+    char           *filename;
+    char           *filename_dl;
+    char           *url;
+    char           *final_url;
+    char           *hash;     /*!< Hex SHA-256 of the file. NULL if not hashed. */
+    int64_t         filesize;
+    ep_store_key_t  key;
+} ep_finalize_t;
+
+static void ep_finalize_destroy(ep_finalize_t *fin)
+{
+    if (fin == NULL)
+        return;
+
+    xfree(fin->castname);
+    xfree(fin->dirpath);
+    xfree(fin->partpath);
+    xfree(fin->filename);
+    xfree(fin->filename_dl);
+    xfree(fin->url);
+    xfree(fin->final_url);
+    xfree(fin->hash);
+    xfree(fin);
+}
+
+/* Copy a finished download from the staging directory to the cast
+ * directory. The copy is written with a ".part" extension and renamed
+ * so a partial copy is never mistaken for a finished episode. */
+static void episode_finalize_copy(void *arg)
+{
+    ep_finalize_t *fin     = arg;
+    int            partfd;
+    int            destfd;
+    int            infd    = -1;
+    int            outfd   = -1;
+    int64_t        avail;
+    bool           nospace = false;
+    bool           ret     = false;
+
+    partfd = dir_index_dir_acquire(ep_dir_index, fin->partpath, false);
+    destfd = dir_index_dir_acquire(ep_dir_index, fin->dirpath, true);
+
+    /* Admission only accounted for the staging directory. The cast
+     * directory gets the same reserve before anything is copied to it.
+     * Preallocating keeps other copies from counting the same space. */
+    if (destfd != -1) {
+        avail   = rw_free_space(fin->dirpath);
+        nospace = avail >= 0 && avail - settings->disk_reserve < fin->filesize;
+    }
+
+    if (partfd != -1 && destfd != -1 && !nospace) {
+        infd  = rw_file_open_read_at(partfd, fin->filename_dl);
+        outfd = rw_file_open_at(destfd, fin->filename_dl, true);
+    }
+    if (outfd != -1 && rw_fd_preallocate(outfd, 0, fin->filesize) == RW_PREALLOC_NOSPACE)
+        nospace = true;
+
+    if (infd != -1 && outfd != -1 && !nospace)
+        ret = rw_fd_copy(outfd, infd);
+    if (infd != -1)
+        close(infd);
+    if (outfd != -1 && close(outfd) != 0)
+        ret = false;
+
+    if (ret)
+        ret = rw_rename_at(destfd, fin->filename_dl, destfd, fin->filename);
+
+    if (ret) {
+        episode_write_checksum(destfd, fin->filename, fin->hash);
+        rw_file_unlink_at(partfd, fin->filename_dl);
+        dir_index_update(ep_dir_index, fin->partpath, fin->filename_dl, -1);
+        dir_index_update(ep_dir_index, fin->dirpath, fin->filename, fin->filesize);
+        episode_dedupe_record(destfd, fin->dirpath, fin->filename, fin->url, fin->final_url, fin->hash, fin->filesize);
+        ep_store_set(ep_states, fin->key, EP_STATE_DOWNLOADED, 0);
+    } else {
+        /* The download is left in the staging directory. */
+        if (outfd != -1)
+            rw_file_unlink_at(destfd, fin->filename_dl);
+        if (nospace) {
+            fprintf(stderr, "Download '%s' Episode '%s' failed: not enough disk space in '%s' (%" PRId64 " bytes needed)\n",
+                    fin->castname, fin->filename, fin->dirpath, fin->filesize);
+        } else {
+            fprintf(stderr, "Download '%s' Episode '%s' failed: could not copy to '%s'\n", fin->castname, fin->filename, fin->dirpath);
+        }
+        was_dl_error = true;
+        ep_store_set(ep_states, fin->key, EP_STATE_FAILED, 0);
+    }
+
+    if (partfd != -1)
+        dir_index_dir_release(ep_dir_index, fin->partpath);
+    if (destfd != -1)
+        dir_index_dir_release(ep_dir_index, fin->dirpath);
+    ep_finalize_destroy(fin);
+}
+
+/* Move a finished download to its final name in the cast directory.
+ * Takes ownership of fin. */
+static void episode_finalize(ep_finalize_t *fin, int partfd)
+{
+    int  destfd = partfd;
+    bool staged;
+    bool copy   = false;
+
+    staged = strcmp(fin->dirpath, fin->partpath) != 0;
+    if (staged) {
+        destfd = dir_index_dir_acquire(ep_dir_index, fin->dirpath, true);
+        if (destfd == -1) {
+            fprintf(stderr, "Could not create or access directory '%s' to save cast '%s'\n", fin->dirpath, fin->castname);
+            was_dl_error = true;
+            ep_store_set(ep_states, fin->key, EP_STATE_FAILED, 0);
+            ep_finalize_destroy(fin);
+            return;
+        }
+    }
+
+    /* Rename the download file to remove the ".part" extension. */
+    if (rw_rename_at(partfd, fin->filename_dl, destfd, fin->filename)) {
+        episode_write_checksum(destfd, fin->filename, fin->hash);
+        dir_index_update(ep_dir_index, fin->partpath, fin->filename_dl, -1);
+        dir_index_update(ep_dir_index, fin->dirpath, fin->filename, fin->filesize);
+        episode_dedupe_record(destfd, fin->dirpath, fin->filename, fin->url, fin->final_url, fin->hash, fin->filesize);
+        ep_store_set(ep_states, fin->key, EP_STATE_DOWNLOADED, 0);
+    } else if (staged && errno == EXDEV) {
+        copy = true;
+    } else {
+        fprintf(stderr, "Could not rename '%s' to '%s'\n", fin->filename_dl, fin->filename);
+        was_dl_error = true;
+        ep_store_set(ep_states, fin->key, EP_STATE_FAILED, 0);
+    }
+
+    if (staged)
+        dir_index_dir_release(ep_dir_index, fin->dirpath);
+
+    if (copy) {
+        /* The staging directory is on a different file system. Copying
+         * is left to the finalize pool so this thread can move on to
+         * the next download. */
+        tpool_add_work(finalize_pool, episode_finalize_copy, fin);
+    } else {
+        ep_finalize_destroy(fin);
+    }
+}
+
+/* Name of the episode's file. Pulled off the URL after the last '/'.
+ * NULL if there isn't one. */
+static const char *episode_filename(const cast_ep_t *cast_ep)
+{
+    const char *filename;
+
+    filename = strrchr(cast_ep_url(cast_ep), '/');
+    /* If the name ends with a '/' then an empty
+     * filename does us no good. */
+    if (filename == NULL || filename[1] == '\0')
+        return NULL;
+    return filename+1;
 }
 
 /* Files will be downloaded with a ".part" extension and renamed
@@ -208,47 +1026,46 @@ static size_t episode_dl_cb(char *ptr, size_t size, size_t nmemb, void *userdata
 static void episode_dler(void *arg)
 {
     cast_ep_t     *cast_ep                = arg;
-    char          *filepath_final;
+    char          *dirpath;
+    char          *partpath;
     char          *filepath_dl;
-    char          *filename;
+    const char    *filename;
+    char          *filename_dl;
+    char          *statename;
+    char          *final_url              = NULL;
     str_builder_t *sb;
-    FILE          *f;
+    ep_finalize_t *fin;
+    ep_dl_t        dl;
+    part_state_t  *ps                     = NULL;
+    const char    *if_range               = NULL;
+    char           hash[SHA256_HEX_LEN];
+    int            partfd;
+    int            fd;
     char           error[CURL_ERROR_SIZE] = { 0 };
     int64_t        filesize               = -1;
     int64_t        expectsize;
     CURLcode       res;
+    int64_t        reserved;
     bool           isresume               = false;
     bool           fail                   = false;
 
-    /* Try to find the filename by pulling it
-     * off after the last '/' */
-    filename = strrchr(cast_ep_url(cast_ep), '/');
-    /* Check if we found a '/'. If the name ends with a '/' then
-     * filename+1 will be a NULL terminator. An empty filename
-     * does us no good. */
-    if (filename == NULL || filename+1 == '\0') {
+    filename = episode_filename(cast_ep);
+    if (filename == NULL) {
         cast_ep_destory(cast_ep);
         return;
     }
-    filename++;
+    memset(&dl, 0, sizeof(dl));
 
-    /* I've seen some bad casts update cast XML with
-     * new times for old episodes. Typically, this happens
-     * when the feed provider is changed but I've also seen
-     * this with some casts that were just bad. Hopefully,
-     * the file hasn't changed and we can use the last modified
-     * time to determine if we really need to download it. */
-    if (!url_has_changed(cast_ep_url(cast_ep))) {
-        cast_ep_destory(cast_ep);
-        return;
-    }
-    
-    filepath_final = rw_join_path(3, settings->cast_dl_dir, cast_ep_prefix_path(cast_ep), filename);
     /* If we already have the file then we don't need to download anything. We don't
      * need to do any file size checks because the file will only be renamed to the
-     * final name after a successful download and file size checks are performed. */
-    if (rw_file_exists(filepath_final)) {
-        xfree(filepath_final);
+     * final name after a successful download and file size checks are performed.
+     *
+     * This is checked first because it's answered from memory. Only the first
+     * episode in a directory reads it from disk. */
+    dirpath = rw_join_path(2, settings->cast_dl_dir, cast_ep_prefix_path(cast_ep));
+    if (dir_index_exists(ep_dir_index, dirpath, filename)) {
+        ep_store_set(ep_states, episode_key(cast_ep), EP_STATE_DOWNLOADED, 0);
+        xfree(dirpath);
         cast_ep_destory(cast_ep);
         return;
     }
@@ -257,24 +1074,40 @@ static void episode_dler(void *arg)
      * but it is safe. I'd rather be safe in case the extension gets updated but the math
      * for the allocation isn't (or isn't updated properly). */
     sb = str_builder_create();
-    str_builder_add_str(sb, filepath_final);
+    str_builder_add_str(sb, filename);
     str_builder_add_str(sb, ".part");
-    filepath_dl = str_builder_dump(sb, NULL);
+    filename_dl = str_builder_dump(sb, NULL);
     str_builder_destroy(sb);
 
-    /* See if we can get the expected file size so we can verify we have a full download. */
+    /* Partial downloads go to the staging directory when there is one. */
+    if (settings->staging_dir != NULL) {
+        partpath = rw_join_path(2, settings->staging_dir, cast_ep_prefix_path(cast_ep));
+    } else {
+        partpath = xstrdup(dirpath);
+    }
+
+    /* Only used for messages. Files are worked on relative to the directory. */
+    filepath_dl = rw_join_path(2, partpath, filename_dl);
+
+    /* The expected file size so we can verify we have a full download. Either
+     * from the feed or the server. 0 if neither said. */
     expectsize = cast_ep_size(cast_ep);
-    if (expectsize <= 0) {
-        /* We don't know how large the file is because it wasn't in
-         * the feed so try and get it from the server. */
-        expectsize = remote_filesize(cast_ep_url(cast_ep));
+
+    if (episode_dedupe(cast_ep_url(cast_ep), cast_ep_final_url(cast_ep), dirpath, filename, expectsize)) {
+        ep_store_set(ep_states, episode_key(cast_ep), EP_STATE_DOWNLOADED, 0);
+        xfree(filepath_dl);
+        xfree(filename_dl);
+        xfree(partpath);
+        xfree(dirpath);
+        cast_ep_destory(cast_ep);
+        return;
     }
 
     /* If keep_partial is set enabled we'll try resuming the download if
-     * the file exists. */
-    if (settings->keep_partial) {
+     * the file exists and the server can send the rest of it. */
+    if (settings->keep_partial && cast_ep_resumable(cast_ep)) {
         /* We need the current file size to know where to resume from. */
-        filesize = rw_file_size(filepath_dl);
+        filesize = dir_index_lookup(ep_dir_index, partpath, filename_dl);
         if (filesize > 0) {
             /* expectsize could be <= 0 because we weren't able to pull it.
              * We've already checked filesize > 0 so this check will always
@@ -292,34 +1125,178 @@ static void episode_dler(void *arg)
         }
     }
 
-    /* If we retry the download and we get a resume download error then, the
-     * server doesn't support resuming a download. If this happens we'll try
-     * downloading from scratch. */
-    do {
-        /* If we're resuming and there is a file (filesize will be > 0), then
-         * open for append so we can resume. Otherwise, open for writing which
-         * will truncate if the file already exists. */
-        if (filesize > 0) {
-            f        = fopen(filepath_dl, "ab");
-        } else {
-            f        = fopen(filepath_dl, "wb");
-            isresume = false;
-            filesize = 0;
-        }
-        if (f == NULL) {
-            fprintf(stderr, "Could not %s file '%s'\n", isresume?"open":"create", filepath_dl);
+    /* If we're resuming and there is a file (filesize will be > 0), then
+     * we write after the existing data. Otherwise, the file is truncated
+     * if it already exists. */
+    if (filesize <= 0) {
+        isresume = false;
+        filesize = 0;
+    }
+
+    /* Only what we don't have yet needs space. */
+    reserved = expectsize>filesize?expectsize-filesize:0;
+    switch (admission_reserve(ep_admission, reserved, cast_ep)) {
+        case ADMISSION_ADMIT:
+            break;
+        case ADMISSION_DEFER:
+            /* The episode will be retried once a running download finishes
+             * and there is room for it. What the probe found stays with
+             * it so the retry doesn't need another request. */
+            xfree(filepath_dl);
+            xfree(filename_dl);
+            xfree(partpath);
+            xfree(dirpath);
+            return;
+        case ADMISSION_REJECT:
+            fprintf(stderr, "Download '%s' Episode '%s' failed: not enough disk space (%" PRId64 " bytes needed)\n",
+                    str_safe(cast_ep_castname(cast_ep)), filename, reserved);
             was_dl_error = true;
-            /* Note: Don't try to delete a partial download file because chances are if the
-             * file can't be opened/created the user can't delete it either. */
+            ep_store_set(ep_states, episode_key(cast_ep), EP_STATE_FAILED, 0);
             xfree(filepath_dl);
-            xfree(filepath_final);
+            xfree(filename_dl);
+            xfree(partpath);
+            xfree(dirpath);
             cast_ep_destory(cast_ep);
             return;
+    }
+
+    /* The directory is only created now that there is something to put in it. */
+    partfd = dir_index_dir_acquire(ep_dir_index, partpath, true);
+    if (partfd == -1) {
+        fprintf(stderr, "Could not create or access directory '%s' to save cast '%s'\n", partpath, str_safe(cast_ep_castname(cast_ep)));
+        was_dl_error = true;
+        ep_store_set(ep_states, episode_key(cast_ep), EP_STATE_FAILED, 0);
+        admission_release(ep_admission, reserved);
+        xfree(filepath_dl);
+        xfree(filename_dl);
+        xfree(partpath);
+        xfree(dirpath);
+        cast_ep_destory(cast_ep);
+        return;
+    }
+
+    fd = rw_file_open_at(partfd, filename_dl, !isresume);
+    if (fd == -1) {
+        fprintf(stderr, "Could not %s file '%s'\n", isresume?"open":"create", filepath_dl);
+        was_dl_error = true;
+        ep_store_set(ep_states, episode_key(cast_ep), EP_STATE_FAILED, 0);
+        /* Note: Don't try to delete a partial download file because chances are if the
+         * file can't be opened/created the user can't delete it either. */
+        dir_index_dir_release(ep_dir_index, partpath);
+        admission_release(ep_admission, reserved);
+        xfree(filepath_dl);
+        xfree(filename_dl);
+        xfree(partpath);
+        xfree(dirpath);
+        cast_ep_destory(cast_ep);
+        return;
+    }
+
+    res = CURLE_OK;
+
+    /* Only resume when the server can tell if the file changed since the
+     * partial download was started. Otherwise the rest of a different
+     * file could be appended to it. */
+    statename = episode_state_name(filename_dl);
+    if (isresume) {
+        ps       = part_state_load(partfd, statename);
+        if_range = episode_if_range(ps);
+        if (if_range == NULL) {
+            isresume = false;
+            filesize = 0;
+            if (ftruncate(fd, 0) != 0) {
+                snprintf(error, sizeof(error), "Could not truncate file '%s'", filepath_dl);
+                res = CURLE_WRITE_ERROR;
+            }
         }
+    }
 
-        res = do_download(cast_ep_url(cast_ep), episode_dl_cb, f, filesize, error, sizeof(error));
-        fclose(f);
-    } while (isresume && res == CURLE_BAD_DOWNLOAD_RESUME);
+    /* The server could have the same validators for a different file
+     * if it's misconfigured. Data already in the file is requested again
+     * and compared before anything is added to it. */
+    if (isresume && settings->verify_resume_tail)
+        dl.tail = episode_read_tail(partfd, filename_dl, filesize, &dl.tail_len);
+
+    /* Continue hashing from where the partial download left off. If the
+     * partial data can't be hashed the download starts over. */
+    if (settings->checksums) {
+        dl.hash = sha256_create();
+        if (isresume && !episode_hash_resume(dl.hash, ps, partfd, filename_dl, filesize)) {
+            isresume = false;
+            filesize = 0;
+            sha256_reset(dl.hash);
+            if (ftruncate(fd, 0) != 0) {
+                snprintf(error, sizeof(error), "Could not truncate file '%s'", filepath_dl);
+                res = CURLE_WRITE_ERROR;
+            }
+        }
+    }
+
+    /* Reserve the space up front so a large episode isn't downloaded
+     * only to find out the disk is full right before it finishes. */
+    if (res == CURLE_OK && expectsize > filesize) {
+        switch (rw_fd_preallocate(fd, filesize, expectsize-filesize)) {
+            case RW_PREALLOC_OK:
+                /* Free space now accounts for the file. */
+                admission_settle(ep_admission, reserved);
+                reserved = 0;
+                break;
+            case RW_PREALLOC_UNSUPPORTED:
+                /* The reservation has to be held until the data is written. */
+                break;
+            case RW_PREALLOC_NOSPACE:
+                snprintf(error, sizeof(error), "Not enough disk space for file '%s' (%" PRId64 " bytes)", filepath_dl, expectsize-filesize);
+                res = CURLE_WRITE_ERROR;
+                break;
+        }
+    }
+
+    /* If we get a resume download error then, the server doesn't support
+     * resuming a download or the file changed since the partial download.
+     * If this happens we'll try downloading from scratch reusing the file
+     * we already have open. */
+    while (res == CURLE_OK) {
+        xfree(final_url);
+        dl.wf = wb_file_open(ep_writer, fd, filesize);
+        res   = do_download(cast_ep_url(cast_ep), episode_dl_cb, episode_header_cb, &dl, filesize-(int64_t)dl.tail_len,
+                isresume?if_range:NULL, &final_url, error, sizeof(error));
+        if (!wb_file_close(dl.wf, settings->sync_episodes) && (res == CURLE_OK || res == CURLE_WRITE_ERROR)) {
+            snprintf(error, sizeof(error), "Could not write to file '%s'", filepath_dl);
+            res = CURLE_WRITE_ERROR;
+        }
+
+        if (!isresume || (res != CURLE_BAD_DOWNLOAD_RESUME && res != CURLE_RANGE_ERROR && !dl.mismatch))
+            break;
+
+        isresume    = false;
+        filesize    = 0;
+        dl.mismatch = false;
+        dl.tail_len = 0;
+        dl.tail_pos = 0;
+        xfree(dl.tail);
+        dl.tail     = NULL;
+        sha256_reset(dl.hash);
+        /* Truncating releases the preallocated space too. */
+        if (ftruncate(fd, 0) != 0) {
+            snprintf(error, sizeof(error), "Could not truncate file '%s'", filepath_dl);
+            res = CURLE_WRITE_ERROR;
+        } else if (expectsize > 0 && rw_fd_preallocate(fd, 0, expectsize) == RW_PREALLOC_NOSPACE) {
+            snprintf(error, sizeof(error), "Not enough disk space for file '%s' (%" PRId64 " bytes)", filepath_dl, expectsize);
+            res = CURLE_WRITE_ERROR;
+        } else {
+            res = CURLE_OK;
+        }
+    }
+
+    /* Size of what was written. Taken from the open file so
+     * the file doesn't have to be looked up again. */
+    filesize = rw_fd_size(fd);
+
+    /* Some file systems (NFS) only report write errors on close. */
+    if (close(fd) != 0 && res == CURLE_OK) {
+        snprintf(error, sizeof(error), "Could not write to file '%s'", filepath_dl);
+        res = CURLE_WRITE_ERROR;
+    }
 
     if (res != CURLE_OK) {
         fprintf(stderr, "Download '%s' Episode '%s' failed: %s\n", str_safe(cast_ep_castname(cast_ep)), filename, error);
@@ -328,7 +1305,6 @@ static void episode_dler(void *arg)
     } else {
         /* Try to verify we got a full download. */
         if (expectsize > 0) {
-            filesize = rw_file_size(filepath_dl); 
             /* It's possible the expected file size was reported wrong and this
              * check will prevent the file from ever downloading. However, that
              * means the feed / server is badly broken and we shouldn't trust
@@ -351,100 +1327,339 @@ static void episode_dler(void *arg)
     /* Delete the file if nothing was ever downloaded. Or if partial resumption
      * isn't enabled. Otherwise leave it so the next run can possibly retry the
      * download. */
-    if (fail && (rw_file_size(filepath_dl) <= 0 || !settings->keep_partial)) {
-        rw_file_unlink(filepath_dl);
+    if (fail) {
+        if (filesize <= 0 || !settings->keep_partial) {
+            rw_file_unlink_at(partfd, filename_dl);
+            part_state_remove(partfd, statename);
+            dir_index_update(ep_dir_index, partpath, filename_dl, -1);
+            ep_store_set(ep_states, episode_key(cast_ep), EP_STATE_FAILED, 0);
+        } else {
+            /* A resumed response doesn't always repeat the validators.
+             * The ones it was resumed with still apply. */
+            if (dl.etag == NULL && dl.last_modified == NULL && isresume) {
+                episode_state_save(partfd, statename, dl.hash, filesize, part_state_get(ps, "etag"), part_state_get(ps, "last_modified"));
+            } else {
+                episode_state_save(partfd, statename, dl.hash, filesize, dl.etag, dl.last_modified);
+            }
+            dir_index_update(ep_dir_index, partpath, filename_dl, filesize);
+            ep_store_set(ep_states, episode_key(cast_ep), EP_STATE_PARTIAL, filesize);
+        }
     } else {
-        /* Rename the download file to remove the ".part" extension. */
-        rw_rename(filepath_dl, filepath_final, true);
+        if (dl.hash != NULL)
+            sha256_digest_hex(dl.hash, hash);
+
+        fin              = xcalloc(1, sizeof(*fin));
+        fin->castname    = xstrdup(str_safe(cast_ep_castname(cast_ep)));
+        fin->dirpath     = xstrdup(dirpath);
+        fin->partpath    = xstrdup(partpath);
+        fin->filename    = xstrdup(filename);
+        fin->filename_dl = xstrdup(filename_dl);
+        fin->url         = xstrdup(cast_ep_url(cast_ep));
+        fin->final_url   = final_url!=NULL?xstrdup(final_url):NULL;
+        fin->hash        = dl.hash!=NULL?xstrdup(hash):NULL;
+        fin->filesize    = filesize;
+        fin->key         = episode_key(cast_ep);
+        episode_finalize(fin, partfd);
+        part_state_remove(partfd, statename);
     }
-
+    dir_index_dir_release(ep_dir_index, partpath);
+
+    /* Last so deferred episodes see the space this one released. */
+    admission_release(ep_admission, reserved);
+
+    sha256_destroy(dl.hash);
+    part_state_destroy(ps);
+    xfree(dl.tail);
+    xfree(dl.etag);
+    xfree(dl.last_modified);
+    xfree(final_url);
+    xfree(statename);
     xfree(filepath_dl);
-    xfree(filepath_final);
+    xfree(filename_dl);
+    xfree(partpath);
+    xfree(dirpath);
     cast_ep_destory(cast_ep);
 }
 
+/* Work out whether an episode needs to be downloaded before it takes a
+ * download slot. Probes only wait on the network so they run at a
+ * higher concurrency than downloads. */
+static void episode_probe(void *arg)
+{
+    cast_ep_t  *cast_ep  = arg;
+    const char *filename;
+    char       *dirpath;
+    ep_probe_t  probe;
+    bool        exists;
+    bool        check_time;
+
+    filename = episode_filename(cast_ep);
+    if (filename == NULL) {
+        cast_ep_destory(cast_ep);
+        return;
+    }
+
+    /* Answered from memory. Saves a request for episodes that are already there. */
+    dirpath = rw_join_path(2, settings->cast_dl_dir, cast_ep_prefix_path(cast_ep));
+    exists  = dir_index_exists(ep_dir_index, dirpath, filename);
+    xfree(dirpath);
+    if (exists) {
+        ep_store_set(ep_states, episode_key(cast_ep), EP_STATE_DOWNLOADED, 0);
+        cast_ep_destory(cast_ep);
+        return;
+    }
+
+    /* First run the lastdl time is 0. There is not need
+     * to check if the url has changed because it's new to us.
+     * Unless it might be a copy of something already downloaded
+     * there is nothing else the request would tell us. */
+    check_time = lastdl != 0 && !settings->ignore_last_modified;
+    if (!check_time && cast_ep_size(cast_ep) > 0 && !episode_dedupe_candidate((int64_t)cast_ep_size(cast_ep))) {
+        download_episode(cast_ep);
+        return;
+    }
+
+    remote_probe(cast_ep_url(cast_ep), &probe);
+
+    /* I've seen some bad casts update cast XML with
+     * new times for old episodes. Typically, this happens
+     * when the feed provider is changed but I've also seen
+     * this with some casts that were just bad. Hopefully,
+     * the file hasn't changed and we can use the last modified
+     * time to determine if we really need to download it. */
+    if (check_time && probe.filetime > 0 && probe.filetime < lastdl) {
+        ep_store_set(ep_states, episode_key(cast_ep), EP_STATE_SEEN, 0);
+        xfree(probe.final_url);
+        cast_ep_destory(cast_ep);
+        return;
+    }
+
+    /* We don't know how large the file is if it wasn't in the feed. */
+    if (cast_ep_size(cast_ep) <= 0 && probe.size > 0)
+        cast_ep_set_size(cast_ep, (size_t)probe.size);
+    cast_ep_set_resumable(cast_ep, probe.resumable);
+    /* Kept with the episode so deduping doesn't need another request
+     * from a download slot. */
+    cast_ep_set_final_url(cast_ep, probe.final_url);
+    xfree(probe.final_url);
+
+    download_episode(cast_ep);
+}
+
 static time_t cast_get_pubdate(xmlDocPtr doc, xmlNodePtr node)
 {
     char      *text;
     struct tm  tm;
+    time_t     pubdate;
 
     memset(&tm, 0, sizeof(tm));
     text = get_xml_text("./pubDate/text()", doc, node);
     if (text == NULL)
         return 0;
 
-    if (strptime(text, "%a, %d %b %Y %H:%M:%S %z", &tm) == NULL) {
-        xfree(text); 
-        return 0;
-    }
+    pubdate = 0;
+    if (strptime(text, "%a, %d %b %Y %H:%M:%S %z", &tm) != NULL)
+        pubdate = mktime(&tm);
+    xfree(text);
+    return pubdate;
+}
+
+/* A feed being parsed. */
+typedef struct {
+    cast_t      *cast;
+    feed_info_t *info;   /*!< State of the feed. Gets the publish history and update hints. */
+    time_t       cutoff; /*!< Episodes published at or before this were handled by an earlier run. 0 if none were. */
+    time_t       newest; /*!< Newest publish date seen. */
+    time_t       now;
+    uint32_t     queued; /*!< Episodes queued for download that have attempts left after this one. */
+    bool         hints;  /*!< The channel's update hints have been read. */
+} feed_parse_t;
+
+/* Read what the channel says about how often it updates. They're
+ * found relative to an item so the document doesn't need to be
+ * searched again. */
+static void cast_parse_feed_hints(feed_parse_t *fp, xmlDocPtr doc, xmlNodePtr node)
+{
+    char *text;
+    char *period;
+    char *freq;
 
+    fp->hints = true;
+
+    /* Minutes. */
+    text          = get_xml_text("../ttl/text()", doc, node);
+    fp->info->ttl = strtoll(str_safe(text), NULL, 10) * 60;
+    if (fp->info->ttl < 0)
+        fp->info->ttl = 0;
     xfree(text);
-    return mktime(&tm);
+
+    /* podcast:updateFrequency shares its local name with sy:updateFrequency. */
+    period = get_xml_text("../*[local-name() = 'updatePeriod']/text()", doc, node);
+    freq   = get_xml_text(
+            "../*[local-name() = 'updateFrequency' and namespace-uri() = 'http://purl.org/rss/1.0/modules/syndication/']/text()",
+            doc, node);
+    fp->info->update_period = feed_sched_sy_period(period, freq);
+    xfree(period);
+    xfree(freq);
+    if (fp->info->update_period == 0) {
+        freq = get_xml_text("../*[local-name() = 'updateFrequency']/@rrule", doc, node);
+        fp->info->update_period = feed_sched_rrule_period(freq);
+        xfree(freq);
+    }
+}
+
+/* Account for an item's publish date in the feed's history. */
+static void cast_parse_feed_pubdate(feed_parse_t *fp, time_t pubdate)
+{
+    if (pubdate > fp->newest)
+        fp->newest = pubdate;
+    /* A date in the future would throw off the schedule. */
+    if (pubdate <= fp->now)
+        feed_info_add_pubdate(fp->info, pubdate);
 }
 
 static bool cast_parse_feed_cb(xmlDocPtr doc, xmlNodePtr node, void *arg)
 {
-    cast_t    *cast    = arg;
-    cast_ep_t *cast_ep;
-    char      *temp;
-    time_t     pubdate = 0;
+    feed_parse_t   *fp      = arg;
+    cast_t         *cast    = fp->cast;
+    cast_ep_t      *cast_ep;
+    char           *url;
+    char           *id;
+    char           *temp;
+    ep_store_key_t  key;
+    ep_state_t      state;
+    time_t          pubdate;
+    uint32_t        failures;
+    bool            ret     = true;
+
+    if (!fp->hints)
+        cast_parse_feed_hints(fp, doc, node);
+
+    /* Only what the episode keeps is copied into the cast's arena.
+     * Everything read from the item is freed once it's been looked at. */
+
+    /* Episodes are identified by their guid. Not every
+     * feed has them so fall back to the enclosure URL. */
+    url = NULL;
+    id  = get_xml_child_text(node, "guid");
+    if (str_isempty(id)) {
+        xfree(id);
+        id  = NULL;
+        url = get_xml_text("./enclosure/@url", doc, node);
+    }
+    key   = ep_store_key(cast_key(cast), id!=NULL?id:url);
+    state = ep_store_get(ep_states, key, NULL, &pubdate, &failures);
+
+    /* Most items were handled by an earlier run. The store has everything
+     * needed from them so the rest of the item doesn't need to be read. */
+    if ((state == EP_STATE_DOWNLOADED || state == EP_STATE_SEEN) && pubdate > 0) {
+        cast_parse_feed_pubdate(fp, pubdate);
+        goto done;
+    }
 
-    if (lastdl > 0) {
-        /* Check if this is older than our last download time
-         * which indicates it was previously downloaded. */
-        pubdate = cast_get_pubdate(doc, node);
-        if (pubdate <= lastdl) {
-            return false;
-        }
+    pubdate = cast_get_pubdate(doc, node);
+    cast_parse_feed_pubdate(fp, pubdate);
+
+    switch (state) {
+        case EP_STATE_DOWNLOADED:
+        case EP_STATE_SEEN:
+            /* Trusted over the publish date. Some feeds give old
+             * episodes new dates. */
+            ep_store_set_pubdate(ep_states, key, pubdate);
+            goto done;
+        case EP_STATE_FAILED:
+        case EP_STATE_PARTIAL:
+            /* Retried no matter how old the episode is, but not forever.
+             * Some will never download and would fail every run. */
+            if (settings->max_attempts > 0 && failures >= settings->max_attempts) {
+                if (url == NULL)
+                    url = get_xml_text("./enclosure/@url", doc, node);
+                fprintf(stderr, "Download '%s' Episode '%s' failed %" PRIu32 " times, giving up\n",
+                        str_safe(cast_name(cast)), str_safe(url), failures);
+                was_dl_error = true;
+                ep_store_set(ep_states, key, EP_STATE_SEEN, 0);
+                ep_store_set_pubdate(ep_states, key, pubdate);
+                goto done;
+            }
+            break;
+        case EP_STATE_NONE:
+            if (fp->cutoff > 0) {
+                /* Check if this is older than the newest episode from the
+                 * last check which indicates it was previously downloaded. */
+                if (pubdate <= fp->cutoff) {
+                    /* Older episodes might have failed and need to be
+                     * retried so keep going when they can be told apart. */
+                    ep_store_set(ep_states, key, EP_STATE_SEEN, 0);
+                    ep_store_set_pubdate(ep_states, key, pubdate);
+                    ret = ep_states != NULL;
+                    goto done;
+                }
+            }
+            break;
     }
 
+    if (url == NULL)
+        url = get_xml_text("./enclosure/@url", doc, node);
+
     /* Check explicit. */
     if (!cast_allow_explicit(cast)) {
         temp = get_xml_text("./*[local-name() = 'explicit']/text()", doc, node);
         if (strncasecmp(temp, "clean", strlen(str_safe(temp))) != 0) {
             xfree(temp);
-            return true;
+            goto done;
         }
         xfree(temp);
     }
 
-    /* Get the cast url. */
-    temp = get_xml_text("./enclosure/@url", doc, node);
-    if (str_isempty(temp)) {
+    /* Check the cast url. */
+    if (str_isempty(url)) {
         fprintf(stderr, "Cast feed '%s' parse error: Couldn't find URL for episode\n", cast_name(cast));
         was_dl_error = true;
-        xfree(temp);
-        return true;
+        goto done;
     }
-    cast_ep = cast_ep_create(temp, cast_name(cast), cast_prefix_path(cast));
-    xfree(temp);
+    cast_ep = cast_ep_create(cast, url);
     if (cast_ep == NULL) {
         /* Something went wrong, but it shouldn't be possible for something
          * to go wrong here. We'll skip this cast. */
-        return true;
+        goto done;
     }
+    if (id != NULL)
+        cast_ep_set_id(cast_ep, id);
 
     /* See if we can get the file size from the enclosure. */
     temp = get_xml_text("./enclosure/@length", doc, node);
-    cast_ep_set_size(cast_ep, strtoll(temp, NULL, 10));
+    cast_ep_set_size(cast_ep, strtoll(str_safe(temp), NULL, 10));
     xfree(temp);
 
     /* If we couldn't get the size from the enclosure try from the 'media:content' tag. */
     if (cast_ep_size(cast_ep) <= 0) {
         temp = get_xml_text("./*[local-name() = 'content']/@fileSize", doc, node);
-        cast_ep_set_size(cast_ep, strtoll(temp, NULL, 10));
+        cast_ep_set_size(cast_ep, strtoll(str_safe(temp), NULL, 10));
         xfree(temp);
     }
 
     /* Start the download. */
-    tpool_add_work(dlep_pool, episode_dler, cast_ep);
-    return true;
+    tpool_add_work(probe_pool, episode_probe, cast_ep);
+    /* Only episodes that could be retried if this attempt fails need
+     * the feed parsed again. One on its last attempt is given up on the
+     * next time the feed is parsed anyway. */
+    if (settings->max_attempts == 0 || failures+1 < settings->max_attempts)
+        fp->queued++;
+
+done:
+    xfree(url);
+    xfree(id);
+    return ret;
 }
 
-static void cast_parse_feed(cast_t *cast, const char *xml)
+/* Returns the newest publish date in the feed. The feed's publish
+ * history, update hints and how many episodes were queued are added
+ * to info. */
+static time_t cast_parse_feed(cast_t *cast, const char *xml, time_t cutoff, feed_info_t *info)
 {
-    char   exp[64];
-    size_t pos;
+    feed_parse_t fp;
+    char         exp[64];
+    size_t       pos;
 
     /* Only attempt to download up to the configured number of recent episodes.
      * Use XPath to select up to the max number of nodes to parse. Since they
@@ -456,7 +1671,7 @@ static void cast_parse_feed(cast_t *cast, const char *xml)
      * queued. */
     pos = settings->recent_num;
     /* First run without unlimited new episodes, only download a single episode. */
-    if (pos == 0 && lastdl == 0)
+    if (pos == 0 && cutoff == 0)
         pos = 1;
 
     if (pos == 0) {
@@ -465,24 +1680,61 @@ static void cast_parse_feed(cast_t *cast, const char *xml)
         /* XPath positions are 1 based not 0 based. */
         snprintf(exp, sizeof(exp), "//channel/item[position() <= %zu]", pos);
     }
-    parse_nodes_int(xml, exp, cast_parse_feed_cb, cast);
-    cast_destroy(cast);
+
+    /* Hints the feed no longer has shouldn't linger. */
+    info->ttl           = 0;
+    info->update_period = 0;
+
+    fp.cast   = cast;
+    fp.info   = info;
+    fp.cutoff = cutoff;
+    fp.newest = 0;
+    fp.now    = time(NULL);
+    fp.queued = 0;
+    fp.hints  = false;
+    parse_nodes_int(xml, exp, cast_parse_feed_cb, &fp);
+
+    info->queued = fp.queued;
+    return fp.newest;
 }
 
 static void cast_parse(void *arg)
 {
     cast_t        *cast                   = arg;
-    str_builder_t *sb;
+    feed_body_t    body;
     char          *xml;
-    xmlNodePtr    *items;
+    char           hash[SHA256_HEX_LEN];
+    feed_info_t    info;
+    feed_info_t    resp;
     char           error[CURL_ERROR_SIZE] = { 0 };
     CURLcode       res;
+    time_t         checked;
+    time_t         since;
+    time_t         cutoff;
+    time_t         newest;
+    bool           known;
+    bool           conditional;
+    bool           notmodified;
 
     if (cast == NULL)
         return;
 
-    if (!url_has_changed(cast_url(cast))) {
-        cast_destroy(cast);
+    /* Each feed is judged by its own history. Feeds that haven't been
+     * checked successfully on their own yet fall back to the last run.
+     * A feed whose checks have only failed so far is known but has
+     * nothing of its own to go on. */
+    known = feed_state_get(feed_states, cast_key(cast), &info);
+    since = info.last_check;
+    if (since == 0)
+        since = lastdl;
+    cutoff = info.newest_pubdate;
+    if (cutoff == 0)
+        cutoff = since;
+    checked = time(NULL);
+
+    if (settings->adaptive_polling && known && !feed_sched_due(&info, checked)) {
+        feed_info_clear(&info);
+        cast_release(cast);
         return;
     }
 
@@ -494,22 +1746,75 @@ static void cast_parse(void *arg)
      *
      * Reading the cast.xml file from disk has the same problem but reading from disk vs
      * a remote sever where we don't control what could be there is a bit different. */
-    sb = str_builder_create();
-
-    res = do_download(cast_url(cast), feed_dl_cb, sb, -1, error, sizeof(error));
+    body.sb    = str_builder_create();
+    body.hash  = sha256_create();
+    body.space = true;
+    memset(&resp, 0, sizeof(resp));
+
+    /* Episodes from the last parse could have failed. They're only found
+     * again by parsing the feed, so it can't be skipped because it hasn't
+     * changed. */
+    conditional = !settings->ignore_last_modified && info.queued == 0;
+    res = feed_download(cast_url(cast), &body, &info, conditional, since, &resp, &notmodified, error, sizeof(error));
     if (res != CURLE_OK) {
         fprintf(stderr, "Could not download feed for '%s': %s\n", cast_name(cast), error);
         was_dl_error = true;
-        str_builder_destroy(sb);
-        cast_destroy(cast);
+        /* Only the failure is recorded. Everything else stays as
+         * it was so the next check picks up where this one should have. */
+        info.failures++;
+        feed_state_put(feed_states, cast_key(cast), &info);
+        feed_info_clear(&info);
+        feed_info_clear(&resp);
+        str_builder_destroy(body.sb);
+        sha256_destroy(body.hash);
+        cast_release(cast);
         return;
     }
 
-    xml = str_builder_dump(sb, NULL);
-    str_builder_destroy(sb);
+    if (!notmodified) {
+        /* Plenty of servers don't support conditional requests or
+         * send the same feed with a new Last-Modified. Parsing it
+         * again would only find what was found last time, unless
+         * episodes it queued then need to be retried. */
+        sha256_digest_hex(body.hash, hash);
+        if (!conditional || info.body_hash == NULL || strcmp(info.body_hash, hash) != 0) {
+            xml = str_builder_dump(body.sb, NULL);
+            newest = cast_parse_feed(cast, xml, cutoff, &info);
+            xfree(xml);
+
+            /* A date in the future would hide every episode until then. */
+            if (newest > checked)
+                newest = checked;
+            if (newest > info.newest_pubdate)
+                info.newest_pubdate = newest;
+
+            xfree(info.body_hash);
+            info.body_hash = xstrdup(hash);
+        }
 
-    cast_parse_feed(cast, xml);
-    xfree(xml);
+        xfree(info.etag);
+        xfree(info.last_modified);
+        info.etag          = resp.etag;
+        info.last_modified = resp.last_modified;
+        resp.etag          = NULL;
+        resp.last_modified = NULL;
+    }
+    str_builder_destroy(body.sb);
+    sha256_destroy(body.hash);
+
+    /* A 304 says how long it can be cached too. */
+    info.max_age    = resp.max_age;
+    info.last_check = checked;
+    info.failures   = 0;
+    info.next_check = feed_sched_next(&info, checked, settings->max_poll_interval);
+    feed_state_put(feed_states, cast_key(cast), &info);
+    feed_info_clear(&info);
+    feed_info_clear(&resp);
+
+    /* Episodes hold their own reference to the cast so it (and everything
+     * allocated from its arena) will stay around until the last one is
+     * finished downloading. */
+    cast_release(cast);
 }
 
 static bool download_casts_cb(xmlDocPtr doc, xmlNodePtr node, void *arg)
@@ -518,12 +1823,13 @@ static bool download_casts_cb(xmlDocPtr doc, xmlNodePtr node, void *arg)
     cast_t *cast;
     bool    allow_explicit;
 
+    (void)doc;
     (void)arg;
 
-    text = get_xml_text("./url//text()", doc, node);
+    text = get_xml_child_text(node, "url");
     if (str_isempty(text)) {
         xfree(text);
-        text = get_xml_text("./name//text()", doc, node);
+        text = get_xml_child_text(node, "name");
         fprintf(stderr, "Could not parse cast entry '%s': Missing URL\n", str_safe(text));
         was_dl_error = true;
         xfree(text);
@@ -536,46 +1842,51 @@ static bool download_casts_cb(xmlDocPtr doc, xmlNodePtr node, void *arg)
         return true;
     }
 
-    text = get_xml_text("./name//text()", doc, node);
+    text = get_xml_child_text(node, "name");
     cast_set_name(cast, text);
     xfree(text);
 
-    text = get_xml_text("./category//text()", doc, node);
+    text = get_xml_child_text(node, "category");
     cast_set_category(cast, text);
     xfree(text);
 
     allow_explicit = settings->allow_explicit;
-    text           = get_xml_text("./explicit//text()", doc, node);
+    text           = get_xml_child_text(node, "explicit");
     if (!str_isempty(text)) {
         allow_explicit = str_istrue(text);
     }
     cast_set_allow_explicit(cast, allow_explicit);
     xfree(text);
 
-    text = rw_join_path(2, settings->cast_dl_dir, cast_prefix_path(cast));
-    if (!rw_create_dir(text)) {
-        fprintf(stderr, "Could not create or access directory '%s' to save cast '%s'\n", text, cast_name(cast));
-        was_dl_error = true;
-        xfree(text);
-        cast_destroy(cast);
-        return true;
-    }
-    xfree(text);
-
     tpool_add_work(feed_pool, cast_parse, cast);
     return true;
 }
 
 /* - - - - */
 
+void download_episode(void *cast_ep)
+{
+    tpool_add_work(dlep_pool, episode_dler, cast_ep);
+}
+
 void download_casts(void)
 {
-    char *casts;
+    rw_map_t *map;
 
-    casts = (char *)rw_read_file(settings->casts_xml_file, NULL);
-    if (casts == NULL)
+    map = rw_map_file(settings->casts_xml_file);
+    if (map == NULL) {
+        fprintf(stderr, "Could not read cast list '%s'\n", settings->casts_xml_file);
+        was_dl_error = true;
         return;
+    }
+
+    /* The cast list is streamed so each cast is handed to the feed
+     * pool as soon as it's read instead of after the whole list has
+     * been parsed. */
+    if (!parse_stream_nodes_mem((const char *)rw_map_data(map), rw_map_len(map), "cast", download_casts_cb, NULL)) {
+        fprintf(stderr, "Could not parse cast list '%s'\n", settings->casts_xml_file);
+        was_dl_error = true;
+    }
 
-    parse_nodes_int(casts, "/casts//cast", download_casts_cb, NULL);
-    xfree(casts);
+    rw_unmap_file(map);
 }
@@ -24,15 +24,37 @@
 #ifndef __DOWNLOADER_H__
 #define __DOWNLOADER_H__
 
+#include "admission.h"
+#include "dedupe.h"
+#include "dir_index.h"
+#include "ep_store.h"
+#include "feed_state.h"
+#include "redirect_cache.h"
 #include "tpool.h"
+#include "writebehind.h"
 
 /* - - - - */
 
 extern tpool_t *feed_pool;
 extern tpool_t *dlep_pool;
+extern tpool_t *finalize_pool;
+extern tpool_t *probe_pool;
+extern writebehind_t *ep_writer;
+extern admission_t *ep_admission;
+extern dir_index_t *ep_dir_index;
+extern dedupe_t *ep_dedupe;
+extern ep_store_t *ep_states;
+extern feed_state_t *feed_states;
+extern redirect_cache_t *ep_redirects;
 extern time_t   lastdl;
 extern bool     was_dl_error;
 
 void download_casts(void);
 
+/*! Queue an episode to be downloaded.
+ *
+ * \param[in] cast_ep Episode. Ownership is taken.
+ */
+void download_episode(void *cast_ep);
+
 #endif /* __DOWNLOADER_H__ */
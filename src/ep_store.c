@@ -0,0 +1,324 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpthread.h"
+#include "ep_store.h"
+#include "rw_files.h"
+#include "sha256.h"
+#include "str_builder.h"
+#include "str_helpers.h"
+#include "xmem.h"
+
+/* - - - - */
+
+#define EP_STORE_MAGIC   "PDEPST01"
+#define EP_STORE_MIN_CAP 1024
+
+/* The file is a header followed by cap slots. Everything is in the
+ * machine's byte order. The store isn't meant to be moved between
+ * machines. */
+typedef struct {
+    char     magic[8];
+    uint64_t cap;     /*!< Number of slots. Power of 2. */
+    uint64_t used;
+    int64_t  created;
+} ep_store_header_t;
+
+typedef struct {
+    uint64_t k[2];    /*!< All 0 when the slot is empty. */
+    int64_t  offset;
+    int64_t  updated;
+    uint32_t state;   /*!< ep_state_t in the low 16 bits. Failed attempts in a row in the high 16. */
+    uint32_t pubdate; /*!< Episode's publish date. 0 if not known. Unsigned so it lasts until 2106. */
+} ep_store_slot_t;
+
+/* Stores from before failures were counted have 0 in the high bits. */
+#define EP_SLOT_STATE(v)    ((v) & 0xffff)
+#define EP_SLOT_FAILURES(v) ((v) >> 16)
+#define EP_FAILURES_MAX     0xffff
+
+struct ep_store {
+    char              *filename;
+    rw_map_t          *map;
+    ep_store_header_t *hdr;
+    ep_store_slot_t   *slots;
+    pthread_mutex_t    mutex;
+};
+
+/* - - - - */
+
+static size_t ep_store_file_len(uint64_t cap)
+{
+    return sizeof(ep_store_header_t) + (size_t)cap*sizeof(ep_store_slot_t);
+}
+
+static bool ep_store_valid(const rw_map_t *map)
+{
+    const ep_store_header_t *hdr;
+
+    if (rw_map_len(map) < sizeof(*hdr))
+        return false;
+
+    hdr = (const ep_store_header_t *)rw_map_data(map);
+    if (memcmp(hdr->magic, EP_STORE_MAGIC, sizeof(hdr->magic)) != 0)
+        return false;
+    if (hdr->cap == 0 || (hdr->cap & (hdr->cap-1)) != 0 || hdr->used >= hdr->cap)
+        return false;
+    return rw_map_len(map) == ep_store_file_len(hdr->cap);
+}
+
+/* Map a new empty store. The file is created full of zeros which
+ * makes every slot empty. */
+static rw_map_t *ep_store_create_file(const char *filename, uint64_t cap, int64_t created)
+{
+    rw_map_t          *map;
+    ep_store_header_t *hdr;
+
+    rw_file_unlink(filename);
+    map = rw_map_file_rw(filename, ep_store_file_len(cap));
+    if (map == NULL)
+        return NULL;
+
+    hdr          = (ep_store_header_t *)rw_map_data_rw(map);
+    hdr->cap     = cap;
+    hdr->used    = 0;
+    hdr->created = created;
+    memcpy(hdr->magic, EP_STORE_MAGIC, sizeof(hdr->magic));
+
+    return map;
+}
+
+static void ep_store_use_map(ep_store_t *st, rw_map_t *map)
+{
+    rw_unmap_file(st->map);
+    st->map   = map;
+    st->hdr   = (ep_store_header_t *)rw_map_data_rw(map);
+    st->slots = (ep_store_slot_t *)(rw_map_data_rw(map)+sizeof(ep_store_header_t));
+}
+
+/* Find the slot for a key. Returns the empty slot the
+ * key would go in if it isn't in the store. */
+static ep_store_slot_t *ep_store_slot(ep_store_slot_t *slots, uint64_t cap, ep_store_key_t key)
+{
+    uint64_t idx;
+
+    idx = key.k[0] & (cap-1);
+    while (1) {
+        if (slots[idx].k[0] == key.k[0] && slots[idx].k[1] == key.k[1])
+            return &slots[idx];
+        if (slots[idx].k[0] == 0 && slots[idx].k[1] == 0)
+            return &slots[idx];
+        idx = (idx+1) & (cap-1);
+    }
+}
+
+/* Double the size of the store. The larger store is built in a new file
+ * and renamed over the old one so the store is never left half copied. */
+static bool ep_store_grow(ep_store_t *st)
+{
+    str_builder_t   *sb;
+    rw_map_t        *map;
+    ep_store_slot_t *slots;
+    char            *tmpname;
+    ep_store_key_t   key;
+    uint64_t         cap;
+    uint64_t         i;
+
+    sb = str_builder_create();
+    str_builder_add_str(sb, st->filename);
+    str_builder_add_str(sb, ".tmp");
+    tmpname = str_builder_dump(sb, NULL);
+    str_builder_destroy(sb);
+
+    cap = st->hdr->cap*2;
+    map = ep_store_create_file(tmpname, cap, st->hdr->created);
+    if (map == NULL) {
+        xfree(tmpname);
+        return false;
+    }
+
+    slots = (ep_store_slot_t *)(rw_map_data_rw(map)+sizeof(ep_store_header_t));
+    for (i=0; i<st->hdr->cap; i++) {
+        if (st->slots[i].k[0] == 0 && st->slots[i].k[1] == 0)
+            continue;
+        key.k[0] = st->slots[i].k[0];
+        key.k[1] = st->slots[i].k[1];
+        *ep_store_slot(slots, cap, key) = st->slots[i];
+    }
+    ((ep_store_header_t *)rw_map_data_rw(map))->used = st->hdr->used;
+
+    if (!rw_rename(tmpname, st->filename, true)) {
+        rw_unmap_file(map);
+        rw_file_unlink(tmpname);
+        xfree(tmpname);
+        return false;
+    }
+
+    ep_store_use_map(st, map);
+    xfree(tmpname);
+    return true;
+}
+
+/* - - - - */
+
+ep_store_t *ep_store_open(const char *filename)
+{
+    ep_store_t *st;
+    rw_map_t   *map;
+
+    if (str_isempty(filename))
+        return NULL;
+
+    map = rw_map_file_rw(filename, 0);
+    if (map != NULL && !ep_store_valid(map)) {
+        fprintf(stderr, "Episode state store '%s' is not valid, starting a new one\n", filename);
+        rw_unmap_file(map);
+        map = NULL;
+    }
+    if (map == NULL)
+        map = ep_store_create_file(filename, EP_STORE_MIN_CAP, (int64_t)time(NULL));
+    if (map == NULL)
+        return NULL;
+
+    st           = xcalloc(1, sizeof(*st));
+    st->filename = xstrdup(filename);
+    ep_store_use_map(st, map);
+    pthread_mutex_init(&(st->mutex), NULL);
+
+    return st;
+}
+
+void ep_store_close(ep_store_t *st)
+{
+    if (st == NULL)
+        return;
+
+    rw_unmap_file(st->map);
+    pthread_mutex_destroy(&(st->mutex));
+    xfree(st->filename);
+    xfree(st);
+}
+
+ep_store_key_t ep_store_key(const char *cast, const char *id)
+{
+    sha256_t       *hash;
+    unsigned char   digest[SHA256_DIGEST_LEN];
+    ep_store_key_t  key;
+
+    hash = sha256_create();
+    sha256_update(hash, str_safe(cast), strlen(str_safe(cast)));
+    sha256_update(hash, "\n", 1);
+    sha256_update(hash, str_safe(id), strlen(str_safe(id)));
+    sha256_digest(hash, digest);
+    sha256_destroy(hash);
+
+    memcpy(key.k, digest, sizeof(key.k));
+    /* All 0 marks an empty slot. */
+    if (key.k[0] == 0 && key.k[1] == 0)
+        key.k[1] = 1;
+    return key;
+}
+
+ep_state_t ep_store_get(ep_store_t *st, ep_store_key_t key, int64_t *offset, time_t *pubdate, uint32_t *failures)
+{
+    ep_store_slot_t *slot;
+    ep_state_t       state;
+
+    if (offset != NULL)
+        *offset = 0;
+    if (pubdate != NULL)
+        *pubdate = 0;
+    if (failures != NULL)
+        *failures = 0;
+
+    if (st == NULL)
+        return EP_STATE_NONE;
+
+    pthread_mutex_lock(&(st->mutex));
+    slot  = ep_store_slot(st->slots, st->hdr->cap, key);
+    state = (ep_state_t)EP_SLOT_STATE(slot->state);
+    if (offset != NULL && state == EP_STATE_PARTIAL)
+        *offset = slot->offset;
+    if (pubdate != NULL)
+        *pubdate = (time_t)slot->pubdate;
+    if (failures != NULL)
+        *failures = EP_SLOT_FAILURES(slot->state);
+    pthread_mutex_unlock(&(st->mutex));
+
+    return state;
+}
+
+void ep_store_set(ep_store_t *st, ep_store_key_t key, ep_state_t state, int64_t offset)
+{
+    ep_store_slot_t *slot;
+    uint32_t         failures = 0;
+
+    if (st == NULL || state == EP_STATE_NONE)
+        return;
+
+    pthread_mutex_lock(&(st->mutex));
+    slot = ep_store_slot(st->slots, st->hdr->cap, key);
+    if (EP_SLOT_STATE(slot->state) == EP_STATE_NONE) {
+        /* Kept at most half full so probes stay short. If the store
+         * can't grow it's used until it's nearly full. */
+        if ((st->hdr->used+1)*2 > st->hdr->cap && ep_store_grow(st))
+            slot = ep_store_slot(st->slots, st->hdr->cap, key);
+        if (st->hdr->used+1 >= st->hdr->cap) {
+            pthread_mutex_unlock(&(st->mutex));
+            return;
+        }
+        slot->k[0] = key.k[0];
+        slot->k[1] = key.k[1];
+        st->hdr->used++;
+    }
+
+    /* Failures are counted until the episode is downloaded or skipped. */
+    if (state == EP_STATE_FAILED || state == EP_STATE_PARTIAL) {
+        failures = EP_SLOT_FAILURES(slot->state);
+        if (failures < EP_FAILURES_MAX)
+            failures++;
+    }
+
+    slot->state   = (uint32_t)state | (failures << 16);
+    slot->offset  = state==EP_STATE_PARTIAL?offset:0;
+    slot->updated = (int64_t)time(NULL);
+    pthread_mutex_unlock(&(st->mutex));
+}
+
+void ep_store_set_pubdate(ep_store_t *st, ep_store_key_t key, time_t pubdate)
+{
+    ep_store_slot_t *slot;
+
+    if (st == NULL || pubdate <= 0 || (uint64_t)pubdate > UINT32_MAX)
+        return;
+
+    pthread_mutex_lock(&(st->mutex));
+    slot = ep_store_slot(st->slots, st->hdr->cap, key);
+    if (EP_SLOT_STATE(slot->state) != EP_STATE_NONE)
+        slot->pubdate = (uint32_t)pubdate;
+    pthread_mutex_unlock(&(st->mutex));
+}
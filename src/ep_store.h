@@ -0,0 +1,126 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __EP_STORE_H__
+#define __EP_STORE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*! \addtogroup ep_store Episode State Store
+ *
+ * Persistent record of what has happened to each episode. Episodes are
+ * identified by a hash of the cast and the item's guid.
+ *
+ * The store is a hash table in a memory mapped file. Opening it doesn't
+ * read it and lookups only touch the pages they need.
+ *
+ * Thread safe.
+ *
+ * @{
+ */
+
+struct ep_store;
+typedef struct ep_store ep_store_t;
+
+/*! State of an episode. Values are stored on disk so they must not change. */
+typedef enum {
+    EP_STATE_NONE       = 0, /*!< Not in the store. */
+    EP_STATE_SEEN       = 1, /*!< Seen in a feed but intentionally not downloaded. */
+    EP_STATE_DOWNLOADED = 2, /*!< Downloaded. */
+    EP_STATE_FAILED     = 3, /*!< Last download attempt failed. */
+    EP_STATE_PARTIAL    = 4  /*!< Last download attempt failed and a partial file was kept. */
+} ep_state_t;
+
+/*! Identifies an episode. */
+typedef struct {
+    uint64_t k[2];
+} ep_store_key_t;
+
+/* - - - - */
+
+/*! Open a store.
+ *
+ * \param[in] filename File the store is kept in. Created if it doesn't
+ *                     exist. Replaced if it isn't a valid store.
+ *
+ * \return Store. NULL on error.
+ */
+ep_store_t *ep_store_open(const char *filename);
+
+/*! Close a store.
+ *
+ * \param[in,out] st Store.
+ */
+void ep_store_close(ep_store_t *st);
+
+/*! Create the key for an episode.
+ *
+ * \param[in] cast Key of the cast the episode is in.
+ * \param[in] id   Episode's guid, or enclosure URL if it doesn't have one.
+ *
+ * \return Key.
+ */
+ep_store_key_t ep_store_key(const char *cast, const char *id);
+
+/*! Get the state of an episode.
+ *
+ * \param[in]  st       Store.
+ * \param[in]  key      Episode.
+ * \param[out] offset   Size of the partial file when EP_STATE_PARTIAL. Can be NULL.
+ * \param[out] pubdate  Publish date of the episode. 0 if not known. Can be NULL.
+ * \param[out] failures Download attempts that have failed in a row. 0 unless
+ *                      EP_STATE_FAILED or EP_STATE_PARTIAL. Can be NULL.
+ *
+ * \return State. EP_STATE_NONE if not in the store or st is NULL.
+ */
+ep_state_t ep_store_get(ep_store_t *st, ep_store_key_t key, int64_t *offset, time_t *pubdate, uint32_t *failures);
+
+/*! Set the state of an episode.
+ *
+ * Setting EP_STATE_FAILED or EP_STATE_PARTIAL counts a failed attempt.
+ * Any other state clears the count.
+ *
+ * \param[in,out] st     Store.
+ * \param[in]     key    Episode.
+ * \param[in]     state  State.
+ * \param[in]     offset Size of the partial file. Only used for EP_STATE_PARTIAL.
+ */
+void ep_store_set(ep_store_t *st, ep_store_key_t key, ep_state_t state, int64_t offset);
+
+/*! Record the publish date of an episode.
+ *
+ * Lets a feed skip reading the items it already knows about. Only
+ * episodes already in the store are updated.
+ *
+ * \param[in,out] st      Store.
+ * \param[in]     key     Episode.
+ * \param[in]     pubdate Publish date.
+ */
+void ep_store_set_pubdate(ep_store_t *st, ep_store_key_t key, time_t pubdate);
+
+/*! @}
+ */
+
+#endif /* __EP_STORE_H__ */
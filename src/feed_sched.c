@@ -0,0 +1,185 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "feed_sched.h"
+#include "str_helpers.h"
+
+/* - - - - */
+
+#define SCHED_HOUR (60*60)
+#define SCHED_DAY  (SCHED_HOUR*24)
+
+/* Runs are usually started by a timer that doesn't fire at
+ * exactly the same second each time. A feed due within this
+ * long is treated as due so it isn't pushed to the next run. */
+#define SCHED_SLACK (5*60)
+
+/* How many checks to make between expected episodes. The
+ * expected delay in finding a new episode is the gap divided
+ * by this. */
+#define SCHED_CHECKS_PER_GAP 4
+
+/* - - - - */
+
+static int64_t sched_unit(const char *s, size_t len)
+{
+    static const struct {
+        const char *name;
+        int64_t     secs;
+    } units[] = {
+        { "hour",  SCHED_HOUR    },
+        { "day",   SCHED_DAY     },
+        { "week",  SCHED_DAY*7   },
+        { "month", SCHED_DAY*30  },
+        { "year",  SCHED_DAY*365 },
+    };
+    size_t i;
+
+    /* Matches both "daily" (sy) and "DAILY" (rrule). */
+    for (i=0; i<sizeof(units)/sizeof(*units); i++) {
+        if (strncasecmp(s, units[i].name, strlen(units[i].name)) == 0)
+            return units[i].secs;
+    }
+    if (len >= 5 && strncasecmp(s, "daily", 5) == 0)
+        return SCHED_DAY;
+    return 0;
+}
+
+static int sched_cmp(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    if (x < y)
+        return -1;
+    return x > y;
+}
+
+/* Typical time between episodes. The median is used
+ * so a single skipped or extra episode doesn't throw it off. */
+static int64_t sched_gap(const feed_info_t *info)
+{
+    int64_t gaps[FEED_HISTORY_LEN];
+    size_t  n    = 0;
+    size_t  i;
+
+    for (i=1; i<FEED_HISTORY_LEN && info->history[i] != 0; i++) {
+        gaps[n++] = (int64_t)(info->history[i-1] - info->history[i]);
+    }
+    if (n == 0)
+        return 0;
+
+    qsort(gaps, n, sizeof(*gaps), sched_cmp);
+    return gaps[n/2];
+}
+
+/* - - - - */
+
+int64_t feed_sched_sy_period(const char *period, const char *frequency)
+{
+    int64_t secs;
+    long    freq;
+
+    /* Daily is the default in the spec but
+     * only when the period is given at all. */
+    if (str_isempty(period))
+        return 0;
+
+    secs = sched_unit(period, strlen(period));
+    if (secs == 0)
+        return 0;
+
+    freq = strtol(str_safe(frequency), NULL, 10);
+    if (freq > 1)
+        secs /= freq;
+    return secs;
+}
+
+int64_t feed_sched_rrule_period(const char *rrule)
+{
+    const char *p;
+    int64_t     secs     = 0;
+    long        interval = 1;
+    size_t      len;
+
+    if (str_isempty(rrule))
+        return 0;
+
+    for (p=rrule; *p != '\0'; p+=len) {
+        len = strcspn(p, ";");
+        if (strncasecmp(p, "FREQ=", 5) == 0) {
+            secs = sched_unit(p+5, len-5);
+        } else if (strncasecmp(p, "INTERVAL=", 9) == 0) {
+            interval = strtol(p+9, NULL, 10);
+        }
+        if (p[len] == ';')
+            len++;
+    }
+
+    if (interval > 1)
+        secs *= interval;
+    return secs;
+}
+
+time_t feed_sched_next(const feed_info_t *info, time_t checked, int64_t max_interval)
+{
+    int64_t interval;
+    int64_t fresh;
+
+    /* Check often enough that a new episode is found well before
+     * the next one. Nothing to go on means check every run. */
+    interval = sched_gap(info) / SCHED_CHECKS_PER_GAP;
+
+    /* The feed saying it updates more often than it has been wins.
+     * A new show might have only a couple of episodes. */
+    if (info->update_period > 0 && (interval == 0 || info->update_period < interval))
+        interval = info->update_period;
+
+    /* There's no point in checking before what was
+     * fetched is allowed to be considered stale. */
+    fresh = info->ttl;
+    if (info->max_age > fresh)
+        fresh = info->max_age;
+    if (fresh > interval)
+        interval = fresh;
+
+    if (max_interval > 0 && interval > max_interval)
+        interval = max_interval;
+    if (interval < 0)
+        interval = 0;
+
+    return checked + (time_t)interval;
+}
+
+bool feed_sched_due(const feed_info_t *info, time_t now)
+{
+    /* Failing feeds are retried every run. So are feeds with
+     * episodes that might have failed. */
+    if (info->failures > 0 || info->queued > 0)
+        return true;
+    return info->next_check <= now + SCHED_SLACK;
+}
@@ -0,0 +1,89 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __FEED_SCHED_H__
+#define __FEED_SCHED_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "feed_state.h"
+
+/*! \addtogroup feed_sched Feed Scheduling
+ *
+ * Decides when a feed needs to be checked again. Most feeds publish
+ * on a regular schedule so checking them on every run mostly finds
+ * nothing new. The schedule is learned from the publish dates of
+ * the feed's episodes and adjusted by what the feed and its server
+ * say about how often it changes.
+ *
+ * @{
+ */
+
+/*! Update period from the syndication module.
+ *
+ * \param[in] period    Value of <sy:updatePeriod> (hourly, daily, weekly,
+ *                      monthly or yearly). Can be NULL.
+ * \param[in] frequency Value of <sy:updateFrequency>. Number of updates
+ *                      per period. Can be NULL.
+ *
+ * \return Seconds between updates. 0 if not known.
+ */
+int64_t feed_sched_sy_period(const char *period, const char *frequency);
+
+/*! Update period from a podcast:updateFrequency rrule.
+ *
+ * Only FREQ and INTERVAL are used.
+ *
+ * \param[in] rrule Recurrence rule. E.g. "FREQ=WEEKLY;INTERVAL=2".
+ *
+ * \return Seconds between updates. 0 if not known.
+ */
+int64_t feed_sched_rrule_period(const char *rrule);
+
+/*! When a feed should next be checked.
+ *
+ * \param[in] info         State of the feed after a successful check.
+ * \param[in] checked      When the feed was checked.
+ * \param[in] max_interval Longest time in seconds a feed can go without
+ *                         being checked.
+ *
+ * \return Time the feed is due. Same as checked if it should be
+ *         checked every run.
+ */
+time_t feed_sched_next(const feed_info_t *info, time_t checked, int64_t max_interval);
+
+/*! Check if a feed is due to be checked.
+ *
+ * \param[in] info State of the feed.
+ * \param[in] now  Current time.
+ *
+ * \return true if the feed should be checked.
+ */
+bool feed_sched_due(const feed_info_t *info, time_t now);
+
+/*! @}
+ */
+
+#endif /* __FEED_SCHED_H__ */
@@ -0,0 +1,340 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpthread.h"
+#include "feed_state.h"
+#include "htable.h"
+#include "rw_files.h"
+#include "str_builder.h"
+#include "str_helpers.h"
+#include "xmem.h"
+
+/* - - - - */
+
+struct feed_state {
+    char            *filename;
+    htable_t        *feeds; /*!< cast key -> feed_info_t */
+    bool             dirty;
+    pthread_mutex_t  mutex;
+};
+
+/* - - - - */
+
+static void feed_info_copy(feed_info_t *dest, const feed_info_t *src)
+{
+    *dest               = *src;
+    dest->etag          = src->etag!=NULL?xstrdup(src->etag):NULL;
+    dest->last_modified = src->last_modified!=NULL?xstrdup(src->last_modified):NULL;
+    dest->body_hash     = src->body_hash!=NULL?xstrdup(src->body_hash):NULL;
+}
+
+static void feed_info_free(void *val)
+{
+    feed_info_clear(val);
+    xfree(val);
+}
+
+/* Values can't have the characters that separate them in the file. */
+static const char *feed_state_valid(const char *s)
+{
+    if (str_isempty(s) || strpbrk(s, "\t\n") != NULL)
+        return NULL;
+    return s;
+}
+
+/* History is a comma separated list of dates. */
+static void feed_state_set_history(feed_info_t *info, const char *val)
+{
+    char   *end;
+    time_t  t;
+
+    while (*val != '\0') {
+        t = (time_t)strtoll(val, &end, 10);
+        if (end == val)
+            break;
+        feed_info_add_pubdate(info, t);
+        val = end;
+        if (*val == ',')
+            val++;
+    }
+}
+
+static void feed_state_set_val(feed_info_t *info, const char *key, const char *val)
+{
+    if (strcmp(key, "checked") == 0) {
+        info->last_check = (time_t)strtoll(val, NULL, 10);
+    } else if (strcmp(key, "pubdate") == 0) {
+        info->newest_pubdate = (time_t)strtoll(val, NULL, 10);
+    } else if (strcmp(key, "etag") == 0) {
+        xfree(info->etag);
+        info->etag = xstrdup(val);
+    } else if (strcmp(key, "last_modified") == 0) {
+        xfree(info->last_modified);
+        info->last_modified = xstrdup(val);
+    } else if (strcmp(key, "body") == 0) {
+        xfree(info->body_hash);
+        info->body_hash = xstrdup(val);
+    } else if (strcmp(key, "failures") == 0) {
+        info->failures = (uint32_t)strtoul(val, NULL, 10);
+    } else if (strcmp(key, "queued") == 0) {
+        info->queued = (uint32_t)strtoul(val, NULL, 10);
+    } else if (strcmp(key, "next") == 0) {
+        info->next_check = (time_t)strtoll(val, NULL, 10);
+    } else if (strcmp(key, "history") == 0) {
+        feed_state_set_history(info, val);
+    } else if (strcmp(key, "period") == 0) {
+        info->update_period = strtoll(val, NULL, 10);
+    } else if (strcmp(key, "ttl") == 0) {
+        info->ttl = strtoll(val, NULL, 10);
+    } else if (strcmp(key, "max_age") == 0) {
+        info->max_age = strtoll(val, NULL, 10);
+    }
+}
+
+/* Lines are the cast key followed by tab separated key=value
+ * pairs. Unknown keys are ignored. */
+static void feed_state_read(feed_state_t *fs)
+{
+    feed_info_t *info;
+    char        *data;
+    char        *line;
+    char        *next;
+    char        *field;
+    char        *next_field;
+    char        *eq;
+
+    data = (char *)rw_read_file(fs->filename, NULL);
+    if (data == NULL)
+        return;
+
+    for (line=data; line != NULL && *line != '\0'; line=next) {
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        field = strchr(line, '\t');
+        if (field == NULL || field == line)
+            continue;
+        *field++ = '\0';
+
+        info = xcalloc(1, sizeof(*info));
+        for (; field != NULL; field=next_field) {
+            next_field = strchr(field, '\t');
+            if (next_field != NULL)
+                *next_field++ = '\0';
+
+            eq = strchr(field, '=');
+            if (eq == NULL)
+                continue;
+            *eq = '\0';
+            feed_state_set_val(info, field, eq+1);
+        }
+        htable_insert(fs->feeds, line, info);
+    }
+
+    xfree(data);
+}
+
+static bool feed_state_write_cb(const char *key, void *val, void *thunk)
+{
+    feed_info_t   *info = val;
+    str_builder_t *sb   = thunk;
+    char           temp[128];
+    size_t         i;
+
+    str_builder_add_str(sb, key);
+    snprintf(temp, sizeof(temp), "\tchecked=%" PRId64 "\tpubdate=%" PRId64 "\tfailures=%" PRIu32 "\tqueued=%" PRIu32,
+            (int64_t)info->last_check, (int64_t)info->newest_pubdate, info->failures, info->queued);
+    str_builder_add_str(sb, temp);
+    snprintf(temp, sizeof(temp), "\tnext=%" PRId64 "\tperiod=%" PRId64 "\tttl=%" PRId64 "\tmax_age=%" PRId64,
+            (int64_t)info->next_check, info->update_period, info->ttl, info->max_age);
+    str_builder_add_str(sb, temp);
+    if (info->history[0] != 0) {
+        str_builder_add_str(sb, "\thistory=");
+        for (i=0; i<FEED_HISTORY_LEN && info->history[i] != 0; i++) {
+            if (i != 0)
+                str_builder_add_char(sb, ',');
+            snprintf(temp, sizeof(temp), "%" PRId64, (int64_t)info->history[i]);
+            str_builder_add_str(sb, temp);
+        }
+    }
+    if (info->etag != NULL) {
+        str_builder_add_str(sb, "\tetag=");
+        str_builder_add_str(sb, info->etag);
+    }
+    if (info->last_modified != NULL) {
+        str_builder_add_str(sb, "\tlast_modified=");
+        str_builder_add_str(sb, info->last_modified);
+    }
+    if (info->body_hash != NULL) {
+        str_builder_add_str(sb, "\tbody=");
+        str_builder_add_str(sb, info->body_hash);
+    }
+    str_builder_add_char(sb, '\n');
+    return true;
+}
+
+/* - - - - */
+
+feed_state_t *feed_state_load(const char *filename)
+{
+    feed_state_t *fs;
+
+    if (str_isempty(filename))
+        return NULL;
+
+    fs           = xcalloc(1, sizeof(*fs));
+    fs->filename = xstrdup(filename);
+    fs->feeds    = htable_create(feed_info_free);
+    pthread_mutex_init(&(fs->mutex), NULL);
+
+    feed_state_read(fs);
+    return fs;
+}
+
+void feed_state_destroy(feed_state_t *fs)
+{
+    if (fs == NULL)
+        return;
+
+    htable_destroy(fs->feeds);
+    pthread_mutex_destroy(&(fs->mutex));
+    xfree(fs->filename);
+    xfree(fs);
+}
+
+bool feed_state_get(feed_state_t *fs, const char *key, feed_info_t *info)
+{
+    feed_info_t *stored;
+    bool         ret    = false;
+
+    if (info == NULL)
+        return false;
+    memset(info, 0, sizeof(*info));
+
+    if (fs == NULL || str_isempty(key))
+        return false;
+
+    pthread_mutex_lock(&(fs->mutex));
+    if (htable_get(fs->feeds, key, (void **)&stored)) {
+        feed_info_copy(info, stored);
+        ret = true;
+    }
+    pthread_mutex_unlock(&(fs->mutex));
+
+    return ret;
+}
+
+bool feed_state_save(feed_state_t *fs)
+{
+    str_builder_t *sb;
+    char          *out;
+    size_t         len;
+    bool           ret;
+
+    if (fs == NULL)
+        return false;
+
+    pthread_mutex_lock(&(fs->mutex));
+    if (!fs->dirty) {
+        pthread_mutex_unlock(&(fs->mutex));
+        return true;
+    }
+
+    sb = str_builder_create();
+    htable_foreach(fs->feeds, feed_state_write_cb, sb);
+    fs->dirty = false;
+    pthread_mutex_unlock(&(fs->mutex));
+
+    out = str_builder_dump(sb, &len);
+    str_builder_destroy(sb);
+
+    ret = rw_replace_file(fs->filename, (const unsigned char *)out, len);
+    xfree(out);
+    return ret;
+}
+
+void feed_state_put(feed_state_t *fs, const char *key, const feed_info_t *info)
+{
+    feed_info_t *stored;
+
+    if (fs == NULL || info == NULL || feed_state_valid(key) == NULL)
+        return;
+
+    stored = xcalloc(1, sizeof(*stored));
+    feed_info_copy(stored, info);
+    /* Values that can't be saved are dropped. The feed
+     * is requested unconditionally next time instead. */
+    if (stored->etag != NULL && feed_state_valid(stored->etag) == NULL) {
+        xfree(stored->etag);
+        stored->etag = NULL;
+    }
+    if (stored->last_modified != NULL && feed_state_valid(stored->last_modified) == NULL) {
+        xfree(stored->last_modified);
+        stored->last_modified = NULL;
+    }
+
+    pthread_mutex_lock(&(fs->mutex));
+    htable_insert(fs->feeds, key, stored);
+    fs->dirty = true;
+    pthread_mutex_unlock(&(fs->mutex));
+}
+
+void feed_info_add_pubdate(feed_info_t *info, time_t pubdate)
+{
+    size_t i;
+    size_t j;
+
+    if (info == NULL || pubdate <= 0)
+        return;
+
+    /* Kept sorted newest first. */
+    for (i=0; i<FEED_HISTORY_LEN && info->history[i] != 0; i++) {
+        if (info->history[i] == pubdate)
+            return;
+        if (info->history[i] < pubdate)
+            break;
+    }
+    if (i == FEED_HISTORY_LEN)
+        return;
+
+    for (j=FEED_HISTORY_LEN-1; j>i; j--)
+        info->history[j] = info->history[j-1];
+    info->history[i] = pubdate;
+}
+
+void feed_info_clear(feed_info_t *info)
+{
+    if (info == NULL)
+        return;
+
+    xfree(info->etag);
+    xfree(info->last_modified);
+    xfree(info->body_hash);
+    memset(info, 0, sizeof(*info));
+}
@@ -0,0 +1,130 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __FEED_STATE_H__
+#define __FEED_STATE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*! \addtogroup feed_state Feed State
+ *
+ * What's known about each feed from previous checks. Kept in memory while
+ * feeds are checked and written for all feeds to a single file, replaced
+ * atomically, when saved. Each feed moves forward on its own even when
+ * others fail.
+ *
+ * Thread safe.
+ *
+ * @{
+ */
+
+struct feed_state;
+typedef struct feed_state feed_state_t;
+
+/*! Number of episode publish dates kept for each feed. */
+#define FEED_HISTORY_LEN 12
+
+/*! State of one feed. */
+typedef struct {
+    time_t    last_check;                /*!< Start of the last successful check. 0 if never checked. */
+    time_t    newest_pubdate;            /*!< Newest episode publish date seen. */
+    time_t    next_check;                /*!< When the feed should be checked again. 0 if it's always due. */
+    time_t    history[FEED_HISTORY_LEN]; /*!< Most recent episode publish dates, newest first. 0 for unused. */
+    int64_t   update_period;             /*!< Seconds between updates the feed says it has. 0 if it doesn't say. */
+    int64_t   ttl;                       /*!< Seconds the feed says it can be cached for (<ttl>). 0 if it doesn't say. */
+    int64_t   max_age;                   /*!< Seconds the last response could be cached for (Cache-Control, Expires). */
+    char     *etag;                      /*!< ETag of the feed from the last check. */
+    char     *last_modified;             /*!< Last-Modified of the feed from the last check. */
+    char     *body_hash;                 /*!< SHA-256 (hex) of the feed's contents with whitespace collapsed. */
+    uint32_t  failures;                  /*!< Consecutive failed checks. */
+    uint32_t  queued;                    /*!< Episodes queued for download by the last parse that can still
+                                              be retried. Until a parse queues none the feed is fetched and
+                                              parsed in full so any that failed are retried. */
+} feed_info_t;
+
+/* - - - - */
+
+/*! Load the feed states.
+ *
+ * \param[in] filename File the states are kept in.
+ *
+ * \return Feed states. Empty if the file doesn't exist.
+ */
+feed_state_t *feed_state_load(const char *filename);
+
+/*! Destroy feed states.
+ *
+ * \param[in,out] fs Feed states.
+ */
+void feed_state_destroy(feed_state_t *fs);
+
+/*! Get the state of a feed.
+ *
+ * \param[in]  fs   Feed states.
+ * \param[in]  key  Key of the cast (cast_key).
+ * \param[out] info State. Zeroed if the feed isn't known. Free with feed_info_clear.
+ *
+ * \return true if the feed is known.
+ */
+bool feed_state_get(feed_state_t *fs, const char *key, feed_info_t *info);
+
+/*! Save the states if any have changed.
+ *
+ * \param[in,out] fs Feed states.
+ *
+ * \return true on success, otherwise false.
+ */
+bool feed_state_save(feed_state_t *fs);
+
+/*! Set the state of a feed.
+ *
+ * Not written to the file until feed_state_save is called.
+ *
+ * \param[in,out] fs   Feed states.
+ * \param[in]     key  Key of the cast (cast_key).
+ * \param[in]     info State. Copied.
+ */
+void feed_state_put(feed_state_t *fs, const char *key, const feed_info_t *info);
+
+/*! Add an episode publish date to a feed's history.
+ *
+ * Dates already in the history are ignored. Only the most
+ * recent FEED_HISTORY_LEN dates are kept.
+ *
+ * \param[in,out] info    State.
+ * \param[in]     pubdate Publish date.
+ */
+void feed_info_add_pubdate(feed_info_t *info, time_t pubdate);
+
+/*! Free the values of a feed state.
+ *
+ * \param[in,out] info State.
+ */
+void feed_info_clear(feed_info_t *info);
+
+/*! @}
+ */
+
+#endif /* __FEED_STATE_H__ */
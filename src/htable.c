@@ -0,0 +1,237 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "htable.h"
+#include "xmem.h"
+
+/* - - - - */
+
+/* Must be a power of 2. */
+#define HTABLE_MIN_BUCKETS 16
+
+/* Entries are stored in place with linear probing. A NULL key is empty. */
+typedef struct {
+    char     *key;
+    void     *val;
+    uint64_t  hash;
+} htable_bucket_t;
+
+struct htable {
+    htable_bucket_t   *buckets;
+    size_t             size;  /*!< Number of buckets. Always a power of 2. */
+    size_t             len;   /*!< Number of entries. */
+    htable_val_free_t  val_free;
+};
+
+/* - - - - */
+
+/* FNV-1a */
+static uint64_t htable_hash(const char *key)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    while (*key != '\0') {
+        h ^= (unsigned char)*key++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static size_t htable_find(const htable_t *ht, const char *key, uint64_t hash)
+{
+    size_t mask = ht->size-1;
+    size_t idx  = (size_t)hash & mask;
+
+    /* The table is never full so this always ends at an empty bucket. */
+    while (ht->buckets[idx].key != NULL) {
+        if (ht->buckets[idx].hash == hash && strcmp(ht->buckets[idx].key, key) == 0)
+            break;
+        idx = (idx+1) & mask;
+    }
+    return idx;
+}
+
+static void htable_grow(htable_t *ht)
+{
+    htable_bucket_t *old      = ht->buckets;
+    size_t           old_size = ht->size;
+    size_t           idx;
+    size_t           i;
+
+    ht->size    = old_size*2;
+    ht->buckets = xcalloc(ht->size, sizeof(*ht->buckets));
+
+    for (i=0; i<old_size; i++) {
+        if (old[i].key == NULL)
+            continue;
+
+        idx = (size_t)old[i].hash & (ht->size-1);
+        while (ht->buckets[idx].key != NULL)
+            idx = (idx+1) & (ht->size-1);
+        ht->buckets[idx] = old[i];
+    }
+
+    xfree(old);
+}
+
+/* - - - - */
+
+htable_t *htable_create(htable_val_free_t val_free)
+{
+    htable_t *ht;
+
+    ht           = xcalloc(1, sizeof(*ht));
+    ht->size     = HTABLE_MIN_BUCKETS;
+    ht->buckets  = xcalloc(ht->size, sizeof(*ht->buckets));
+    ht->val_free = val_free;
+
+    return ht;
+}
+
+void htable_destroy(htable_t *ht)
+{
+    size_t i;
+
+    if (ht == NULL)
+        return;
+
+    for (i=0; i<ht->size; i++) {
+        if (ht->buckets[i].key == NULL)
+            continue;
+
+        xfree(ht->buckets[i].key);
+        if (ht->val_free != NULL)
+            ht->val_free(ht->buckets[i].val);
+    }
+
+    xfree(ht->buckets);
+    xfree(ht);
+}
+
+void htable_insert(htable_t *ht, const char *key, void *val)
+{
+    uint64_t hash;
+    size_t   idx;
+
+    if (ht == NULL || key == NULL)
+        return;
+
+    hash = htable_hash(key);
+    idx  = htable_find(ht, key, hash);
+    if (ht->buckets[idx].key != NULL) {
+        if (ht->val_free != NULL && ht->buckets[idx].val != val)
+            ht->val_free(ht->buckets[idx].val);
+        ht->buckets[idx].val = val;
+        return;
+    }
+
+    /* Keep the load under 3/4 so probe runs stay short. */
+    if ((ht->len+1)*4 > ht->size*3) {
+        htable_grow(ht);
+        idx = htable_find(ht, key, hash);
+    }
+
+    ht->buckets[idx].key  = xstrdup(key);
+    ht->buckets[idx].val  = val;
+    ht->buckets[idx].hash = hash;
+    ht->len++;
+}
+
+bool htable_remove(htable_t *ht, const char *key)
+{
+    size_t mask;
+    size_t idx;
+    size_t next;
+    size_t home;
+
+    if (ht == NULL || key == NULL)
+        return false;
+
+    idx = htable_find(ht, key, htable_hash(key));
+    if (ht->buckets[idx].key == NULL)
+        return false;
+
+    xfree(ht->buckets[idx].key);
+    if (ht->val_free != NULL)
+        ht->val_free(ht->buckets[idx].val);
+    ht->buckets[idx].key = NULL;
+    ht->len--;
+
+    /* Shift following entries back so no probe run has a gap in it.
+     * An entry can only move if the hole is between its home bucket
+     * and where it currently is. */
+    mask = ht->size-1;
+    next = (idx+1) & mask;
+    while (ht->buckets[next].key != NULL) {
+        home = (size_t)ht->buckets[next].hash & mask;
+        if (((next - home) & mask) >= ((next - idx) & mask)) {
+            ht->buckets[idx]      = ht->buckets[next];
+            ht->buckets[next].key = NULL;
+            idx                   = next;
+        }
+        next = (next+1) & mask;
+    }
+
+    return true;
+}
+
+bool htable_get(const htable_t *ht, const char *key, void **val)
+{
+    size_t idx;
+
+    if (ht == NULL || key == NULL)
+        return false;
+
+    idx = htable_find(ht, key, htable_hash(key));
+    if (ht->buckets[idx].key == NULL)
+        return false;
+
+    if (val != NULL)
+        *val = ht->buckets[idx].val;
+    return true;
+}
+
+size_t htable_len(const htable_t *ht)
+{
+    if (ht == NULL)
+        return 0;
+    return ht->len;
+}
+
+void htable_foreach(const htable_t *ht, htable_foreach_cb cb, void *thunk)
+{
+    size_t i;
+
+    if (ht == NULL || cb == NULL)
+        return;
+
+    for (i=0; i<ht->size; i++) {
+        if (ht->buckets[i].key == NULL)
+            continue;
+        if (!cb(ht->buckets[i].key, ht->buckets[i].val, thunk))
+            return;
+    }
+}
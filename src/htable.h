@@ -0,0 +1,114 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __HTABLE_H__
+#define __HTABLE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*! \addtogroup htable Hash Table
+ *
+ * String keyed hash table. Keys are copied. Values are owned by the
+ * table when a free callback is provided.
+ *
+ * Not thread safe.
+ *
+ * @{
+ */
+
+struct htable;
+typedef struct htable htable_t;
+
+/*! Callback to free a value. */
+typedef void (*htable_val_free_t)(void *val);
+
+/*! Callback for visiting entries.
+ *
+ * \return true to continue, false to stop.
+ */
+typedef bool (*htable_foreach_cb)(const char *key, void *val, void *thunk);
+
+/* - - - - */
+
+/*! Create a hash table.
+ *
+ * \param[in] val_free Callback to free values. Can be NULL.
+ *
+ * \return Hash table.
+ */
+htable_t *htable_create(htable_val_free_t val_free);
+
+/*! Destroy a hash table.
+ *
+ * \param[in,out] ht Hash table.
+ */
+void htable_destroy(htable_t *ht);
+
+/*! Insert a value.
+ *
+ * \param[in,out] ht  Hash table.
+ * \param[in]     key Key. Copied.
+ * \param[in]     val Value. Replaces and frees any existing value.
+ */
+void htable_insert(htable_t *ht, const char *key, void *val);
+
+/*! Remove a value.
+ *
+ * \param[in,out] ht  Hash table.
+ * \param[in]     key Key.
+ *
+ * \return true if the key was present.
+ */
+bool htable_remove(htable_t *ht, const char *key);
+
+/*! Get a value.
+ *
+ * \param[in]  ht  Hash table.
+ * \param[in]  key Key.
+ * \param[out] val Value. Can be NULL to only check if the key is present.
+ *
+ * \return true if the key was present.
+ */
+bool htable_get(const htable_t *ht, const char *key, void **val);
+
+/*! Number of entries.
+ *
+ * \param[in] ht Hash table.
+ *
+ * \return Count.
+ */
+size_t htable_len(const htable_t *ht);
+
+/*! Visit every entry. The table must not be modified while visiting.
+ *
+ * \param[in] ht    Hash table.
+ * \param[in] cb    Callback.
+ * \param[in] thunk Passed to the callback.
+ */
+void htable_foreach(const htable_t *ht, htable_foreach_cb cb, void *thunk);
+
+/*! @}
+ */
+
+#endif /* __HTABLE_H__ */
@@ -85,15 +85,124 @@ static void update_last_download(void)
     }
 }
 
+static void print_hist(const char *label, const uint64_t *hist)
+{
+    size_t i;
+
+    fprintf(stderr, "  %s:", label);
+    for (i=0; i<TPOOL_HIST_BUCKETS; i++) {
+        if (hist[i] == 0)
+            continue;
+
+        if (i == 0) {
+            fprintf(stderr, " <1ms=%" PRIu64, hist[i]);
+        } else if (i == TPOOL_HIST_BUCKETS-1) {
+            fprintf(stderr, " >=%" PRIu64 "ms=%" PRIu64, (uint64_t)1 << (i-1), hist[i]);
+        } else {
+            fprintf(stderr, " %" PRIu64 "-%" PRIu64 "ms=%" PRIu64, (uint64_t)1 << (i-1), (uint64_t)1 << i, hist[i]);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+static void print_pool_stats(const char *name, tpool_t *tp)
+{
+    tpool_stats_t *stats;
+    size_t         i;
+
+    stats = tpool_stats_snapshot(tp);
+    if (stats == NULL)
+        return;
+
+    fprintf(stderr, "%s: submitted=%" PRIu64 " completed=%" PRIu64 " queue=%zu queue_max=%zu\n",
+            name, stats->submitted, stats->completed, stats->queue_depth, stats->queue_depth_max);
+    fprintf(stderr, "  wait: avg=%.1fms max=%.1fms run: avg=%.1fms max=%.1fms\n",
+            stats->completed?(double)stats->wait_ns_total/stats->completed/1000000.0:0,
+            (double)stats->wait_ns_max/1000000.0,
+            stats->completed?(double)stats->run_ns_total/stats->completed/1000000.0:0,
+            (double)stats->run_ns_max/1000000.0);
+    print_hist("wait", stats->wait_hist);
+    print_hist("run", stats->run_hist);
+
+    fprintf(stderr, "  busy:");
+    for (i=0; i<stats->worker_cnt; i++) {
+        fprintf(stderr, " %.1f%%", tpool_stats_worker_busy(stats, i)*100.0);
+    }
+    fprintf(stderr, "\n");
+
+    tpool_stats_destroy(stats);
+}
+
+static void print_mem_stats(void)
+{
+    xmem_stats_t     *stats;
+    xmem_tag_stats_t *top[10] = { NULL };
+    xmem_tag_stats_t *ts;
+    const char       *tag;
+    size_t            i;
+    size_t            j;
+
+    stats = xmem_stats_snapshot();
+    if (stats == NULL)
+        return;
+
+    fprintf(stderr, "memory (%s): live=%zu peak=%zu allocs=%" PRIu64 " reallocs=%" PRIu64 " frees=%" PRIu64 " sites=%zu\n",
+            xmem_allocator_name(), stats->live, stats->peak, stats->allocs, stats->reallocs, stats->frees, stats->tag_cnt);
+
+    /* Keep the call sites with the largest peak, largest first. */
+    for (i=0; i<XMEM_TAGS_MAX; i++) {
+        ts = &stats->tags[i];
+        if (ts->tag == NULL || ts->allocs == 0)
+            continue;
+
+        for (j=0; j<sizeof(top)/sizeof(*top); j++) {
+            if (top[j] == NULL || ts->peak > top[j]->peak) {
+                memmove(top+j+1, top+j, (sizeof(top)/sizeof(*top)-j-1)*sizeof(*top));
+                top[j] = ts;
+                break;
+            }
+        }
+    }
+
+    for (i=0; i<sizeof(top)/sizeof(*top) && top[i]!=NULL; i++) {
+        /* Tags are the full path to the file which is more noise than useful. */
+        tag = strrchr(top[i]->tag, '/');
+        tag = tag==NULL?top[i]->tag:tag+1;
+        fprintf(stderr, "  %s: peak=%zu live=%zu allocs=%" PRIu64 "\n", tag, top[i]->peak, top[i]->live, top[i]->allocs);
+    }
+
+    xfree(stats);
+}
+
 static bool init(char *error, size_t errlen)
 {
+    uint32_t wb_flags = WB_FLAG_NONE;
+
     if (!settings_load(error, errlen))
         return false;
 
     get_last_download();
 
-    feed_pool = tpool_create(settings->feed_threads);
-    dlep_pool = tpool_create(settings->dlep_threads);
+    feed_pool  = tpool_create(settings->feed_threads);
+    dlep_pool  = tpool_create(settings->dlep_threads);
+    probe_pool = tpool_create(settings->probe_threads);
+    if (settings->use_io_uring)
+        wb_flags |= WB_FLAG_URING;
+    if (settings->drop_cache)
+        wb_flags |= WB_FLAG_DROP_CACHE;
+    ep_writer = wb_create(settings->write_buffer_size, settings->write_buffers, settings->writer_threads, wb_flags);
+    /* Copies are limited by the destination disk so one thread is enough. */
+    if (settings->staging_dir != NULL)
+        finalize_pool = tpool_create(1);
+    ep_dir_index = dir_index_create();
+    if (settings->dedupe)
+        ep_dedupe = dedupe_create(settings->dedupe_file);
+    feed_states  = feed_state_load(settings->feed_state_file);
+    ep_redirects = redirect_cache_create(settings->redirect_file, settings->redirect_ttl);
+    ep_states    = ep_store_open(settings->ep_state_file);
+    if (ep_states == NULL)
+        fprintf(stderr, "Could not open episode state store '%s'\n", settings->ep_state_file);
+    ep_admission = admission_create(settings->staging_dir!=NULL?settings->staging_dir:settings->cast_dl_dir, settings->disk_reserve, download_episode);
 
     curl_global_init(CURL_GLOBAL_DEFAULT);
     return true;
@@ -101,13 +210,47 @@ static bool init(char *error, size_t errlen)
 
 static void deinit(void)
 {
+    bool print_stats;
+
     update_last_download();
 
+    print_stats = settings->print_stats;
+    if (print_stats) {
+        print_pool_stats("feed pool", feed_pool);
+        print_pool_stats("probe pool", probe_pool);
+        print_pool_stats("download pool", dlep_pool);
+        if (finalize_pool != NULL)
+            print_pool_stats("finalize pool", finalize_pool);
+        fprintf(stderr, "episode writer: %s\n", wb_backend(ep_writer));
+    }
+
+    tpool_destroy(probe_pool);
     tpool_destroy(dlep_pool);
+    tpool_destroy(finalize_pool);
+    wb_destroy(ep_writer);
+    admission_destroy(ep_admission);
+    dir_index_destroy(ep_dir_index);
+    if (ep_dedupe != NULL && !dedupe_save(ep_dedupe))
+        fprintf(stderr, "Could not save dedupe index '%s'\n", settings->dedupe_file);
+    dedupe_destroy(ep_dedupe);
+    ep_store_close(ep_states);
+    /* Only saved once every episode has finished. A feed's newest publish
+     * date can't be kept if the episodes under it never got the chance to
+     * download, otherwise they'd be taken as handled on the next run. */
+    if (feed_states != NULL && !feed_state_save(feed_states))
+        fprintf(stderr, "Could not save feed state '%s'\n", settings->feed_state_file);
+    feed_state_destroy(feed_states);
+    if (!redirect_cache_save(ep_redirects))
+        fprintf(stderr, "Could not save redirect cache '%s'\n", settings->redirect_file);
+    redirect_cache_destroy(ep_redirects);
     tpool_destroy(feed_pool);
     settings_unload();
 
     curl_global_cleanup();
+
+    /* Last so anything still live is a leak. */
+    if (print_stats)
+        print_mem_stats();
 }
 
 int main(int argc, char **argv)
@@ -122,7 +265,9 @@ int main(int argc, char **argv)
     download_casts();
 
     tpool_wait(feed_pool);
+    tpool_wait(probe_pool);
     tpool_wait(dlep_pool);
+    tpool_wait(finalize_pool);
 
     deinit();
 
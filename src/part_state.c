@@ -0,0 +1,181 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "htable.h"
+#include "part_state.h"
+#include "rw_files.h"
+#include "str_builder.h"
+#include "str_helpers.h"
+#include "xmem.h"
+
+/* - - - - */
+
+struct part_state {
+    htable_t *vals; /*!< key -> value string */
+};
+
+/* - - - - */
+
+static void part_state_val_free(void *val)
+{
+    xfree(val);
+}
+
+static bool part_state_save_cb(const char *key, void *val, void *thunk)
+{
+    str_builder_t *sb = thunk;
+
+    str_builder_add_str(sb, key);
+    str_builder_add_char(sb, '=');
+    str_builder_add_str(sb, val);
+    str_builder_add_char(sb, '\n');
+    return true;
+}
+
+/* - - - - */
+
+part_state_t *part_state_create(void)
+{
+    part_state_t *ps;
+
+    ps       = xcalloc(1, sizeof(*ps));
+    ps->vals = htable_create(part_state_val_free);
+    return ps;
+}
+
+void part_state_destroy(part_state_t *ps)
+{
+    if (ps == NULL)
+        return;
+
+    htable_destroy(ps->vals);
+    xfree(ps);
+}
+
+part_state_t *part_state_load(int dirfd, const char *name)
+{
+    part_state_t *ps;
+    char         *data;
+    char         *line;
+    char         *next;
+    char         *eq;
+
+    data = (char *)rw_read_file_at(dirfd, name, NULL);
+    if (data == NULL)
+        return NULL;
+
+    ps = part_state_create();
+    for (line=data; line != NULL && *line != '\0'; line=next) {
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        /* Lines that aren't key=value are ignored. */
+        eq = strchr(line, '=');
+        if (eq == NULL || eq == line)
+            continue;
+        *eq = '\0';
+        part_state_set(ps, line, eq+1);
+    }
+
+    xfree(data);
+    return ps;
+}
+
+bool part_state_save(const part_state_t *ps, int dirfd, const char *name)
+{
+    str_builder_t *sb;
+    char          *out;
+    size_t         len;
+    bool           ret;
+
+    if (ps == NULL)
+        return false;
+
+    sb = str_builder_create();
+    htable_foreach(ps->vals, part_state_save_cb, sb);
+    out = str_builder_dump(sb, &len);
+    str_builder_destroy(sb);
+
+    ret = rw_write_file_at(dirfd, name, (const unsigned char *)out, len);
+    xfree(out);
+    return ret;
+}
+
+void part_state_remove(int dirfd, const char *name)
+{
+    rw_file_unlink_at(dirfd, name);
+}
+
+const char *part_state_get(const part_state_t *ps, const char *key)
+{
+    void *val;
+
+    if (ps == NULL || !htable_get(ps->vals, key, &val))
+        return NULL;
+    return val;
+}
+
+int64_t part_state_get_int(const part_state_t *ps, const char *key)
+{
+    const char *val;
+    char       *end;
+    long long   lval;
+
+    val = part_state_get(ps, key);
+    if (str_isempty(val))
+        return -1;
+
+    lval = strtoll(val, &end, 10);
+    if (*end != '\0')
+        return -1;
+    return (int64_t)lval;
+}
+
+void part_state_set(part_state_t *ps, const char *key, const char *val)
+{
+    if (ps == NULL || str_isempty(key) || strpbrk(key, "=\n") != NULL)
+        return;
+
+    if (val == NULL) {
+        htable_remove(ps->vals, key);
+        return;
+    }
+    if (strchr(val, '\n') != NULL)
+        return;
+
+    htable_insert(ps->vals, key, xstrdup(val));
+}
+
+void part_state_set_int(part_state_t *ps, const char *key, int64_t val)
+{
+    char temp[32];
+
+    snprintf(temp, sizeof(temp), "%" PRId64, val);
+    part_state_set(ps, key, temp);
+}
@@ -0,0 +1,120 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __PART_STATE_H__
+#define __PART_STATE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! \addtogroup part_state Partial Download State
+ *
+ * Information about a partial download that's needed to resume it. Saved
+ * next to the partial file as simple "key=value" lines.
+ *
+ * @{
+ */
+
+struct part_state;
+typedef struct part_state part_state_t;
+
+/* - - - - */
+
+/*! Create an empty state.
+ *
+ * \return State.
+ */
+part_state_t *part_state_create(void);
+
+/*! Destroy a state.
+ *
+ * \param[in,out] ps State.
+ */
+void part_state_destroy(part_state_t *ps);
+
+/*! Load a state.
+ *
+ * \param[in] dirfd Open directory the state is in.
+ * \param[in] name  Name of the state file.
+ *
+ * \return State. NULL if it doesn't exist or can't be read.
+ */
+part_state_t *part_state_load(int dirfd, const char *name);
+
+/*! Save a state.
+ *
+ * The state file is replaced atomically.
+ *
+ * \param[in] ps    State.
+ * \param[in] dirfd Open directory to save the state in.
+ * \param[in] name  Name of the state file.
+ *
+ * \return true on success, otherwise false.
+ */
+bool part_state_save(const part_state_t *ps, int dirfd, const char *name);
+
+/*! Delete a saved state.
+ *
+ * \param[in] dirfd Open directory the state is in.
+ * \param[in] name  Name of the state file.
+ */
+void part_state_remove(int dirfd, const char *name);
+
+/*! Get a value.
+ *
+ * \param[in] ps  State.
+ * \param[in] key Key.
+ *
+ * \return Value. NULL if not set.
+ */
+const char *part_state_get(const part_state_t *ps, const char *key);
+
+/*! Get a value as an integer.
+ *
+ * \param[in] ps  State.
+ * \param[in] key Key.
+ *
+ * \return Value. -1 if not set or not a valid integer.
+ */
+int64_t part_state_get_int(const part_state_t *ps, const char *key);
+
+/*! Set a value.
+ *
+ * \param[in,out] ps  State.
+ * \param[in]     key Key. Cannot contain '=' or a new line.
+ * \param[in]     val Value. Cannot contain a new line. NULL removes the key.
+ */
+void part_state_set(part_state_t *ps, const char *key, const char *val);
+
+/*! Set an integer value.
+ *
+ * \param[in,out] ps  State.
+ * \param[in]     key Key.
+ * \param[in]     val Value.
+ */
+void part_state_set_int(part_state_t *ps, const char *key, int64_t val);
+
+/*! @}
+ */
+
+#endif /* __PART_STATE_H__ */
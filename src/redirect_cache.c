@@ -0,0 +1,252 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpthread.h"
+#include "htable.h"
+#include "redirect_cache.h"
+#include "rw_files.h"
+#include "str_builder.h"
+#include "str_helpers.h"
+#include "xmem.h"
+
+/* - - - - */
+
+typedef struct {
+    char    *final_url;
+    int64_t  expires; /*!< 0 when the entry doesn't expire. */
+} redirect_entry_t;
+
+struct redirect_cache {
+    char            *filename;
+    htable_t        *urls; /*!< url -> redirect_entry_t */
+    int64_t          ttl;
+    bool             dirty;
+    pthread_mutex_t  mutex;
+};
+
+/* - - - - */
+
+static void redirect_entry_free(void *val)
+{
+    redirect_entry_t *re = val;
+
+    if (re == NULL)
+        return;
+
+    xfree(re->final_url);
+    xfree(re);
+}
+
+/* Must be called with the lock held. */
+static void redirect_cache_add_int(redirect_cache_t *rc, const char *url, const char *final_url, int64_t expires)
+{
+    redirect_entry_t *re;
+
+    re            = xcalloc(1, sizeof(*re));
+    re->final_url = xstrdup(final_url);
+    re->expires   = expires;
+    htable_insert(rc->urls, url, re);
+}
+
+static void redirect_cache_load(redirect_cache_t *rc)
+{
+    char    *data;
+    char    *line;
+    char    *next;
+    char    *url;
+    char    *final_url;
+    char    *end;
+    int64_t  expires;
+    int64_t  now;
+
+    data = (char *)rw_read_file(rc->filename, NULL);
+    if (data == NULL)
+        return;
+
+    /* Lines are "expires<tab>url<tab>final url". */
+    now = (int64_t)time(NULL);
+    for (line=data; line != NULL && *line != '\0'; line=next) {
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        url = strchr(line, '\t');
+        if (url == NULL)
+            continue;
+        *url++ = '\0';
+        final_url = strchr(url, '\t');
+        if (final_url == NULL)
+            continue;
+        *final_url++ = '\0';
+
+        expires = strtoll(line, &end, 10);
+        if (*end != '\0' || expires <= now || str_isempty(url) || str_isempty(final_url)) {
+            /* Dropping expired entries changes the file. */
+            rc->dirty = true;
+            continue;
+        }
+
+        redirect_cache_add_int(rc, url, final_url, expires);
+    }
+
+    xfree(data);
+}
+
+static bool redirect_cache_save_cb(const char *key, void *val, void *thunk)
+{
+    redirect_entry_t *re = val;
+    str_builder_t    *sb = thunk;
+    char              temp[32];
+
+    snprintf(temp, sizeof(temp), "%" PRId64, re->expires);
+    str_builder_add_str(sb, temp);
+    str_builder_add_char(sb, '\t');
+    str_builder_add_str(sb, key);
+    str_builder_add_char(sb, '\t');
+    str_builder_add_str(sb, re->final_url);
+    str_builder_add_char(sb, '\n');
+    return true;
+}
+
+/* - - - - */
+
+redirect_cache_t *redirect_cache_create(const char *filename, int64_t ttl)
+{
+    redirect_cache_t *rc;
+
+    rc       = xcalloc(1, sizeof(*rc));
+    rc->urls = htable_create(redirect_entry_free);
+    pthread_mutex_init(&(rc->mutex), NULL);
+
+    if (!str_isempty(filename) && ttl > 0) {
+        rc->filename = xstrdup(filename);
+        rc->ttl      = ttl;
+        redirect_cache_load(rc);
+    }
+
+    return rc;
+}
+
+void redirect_cache_destroy(redirect_cache_t *rc)
+{
+    if (rc == NULL)
+        return;
+
+    htable_destroy(rc->urls);
+    pthread_mutex_destroy(&(rc->mutex));
+    xfree(rc->filename);
+    xfree(rc);
+}
+
+bool redirect_cache_save(redirect_cache_t *rc)
+{
+    str_builder_t *sb;
+    char          *out;
+    size_t         len;
+    bool           ret = true;
+
+    if (rc == NULL)
+        return false;
+
+    pthread_mutex_lock(&(rc->mutex));
+    if (rc->filename == NULL || !rc->dirty) {
+        pthread_mutex_unlock(&(rc->mutex));
+        return true;
+    }
+
+    sb = str_builder_create();
+    htable_foreach(rc->urls, redirect_cache_save_cb, sb);
+    rc->dirty = false;
+    pthread_mutex_unlock(&(rc->mutex));
+
+    out = str_builder_dump(sb, &len);
+    str_builder_destroy(sb);
+
+    if (len == 0) {
+        rw_file_unlink(rc->filename);
+    } else {
+        ret = rw_replace_file(rc->filename, (const unsigned char *)out, len);
+    }
+
+    xfree(out);
+    return ret;
+}
+
+char *redirect_cache_get(redirect_cache_t *rc, const char *url)
+{
+    redirect_entry_t *re;
+    char             *out = NULL;
+
+    if (rc == NULL || str_isempty(url))
+        return NULL;
+
+    pthread_mutex_lock(&(rc->mutex));
+    if (htable_get(rc->urls, url, (void **)&re)) {
+        if (re->expires == 0 || re->expires > (int64_t)time(NULL)) {
+            out = xstrdup(re->final_url);
+        } else {
+            htable_remove(rc->urls, url);
+            rc->dirty = true;
+        }
+    }
+    pthread_mutex_unlock(&(rc->mutex));
+
+    return out;
+}
+
+void redirect_cache_put(redirect_cache_t *rc, const char *url, const char *final_url)
+{
+    if (rc == NULL || str_isempty(url) || str_isempty(final_url))
+        return;
+
+    if (strcmp(url, final_url) == 0) {
+        redirect_cache_remove(rc, url);
+        return;
+    }
+
+    /* Values can't have the characters that separate them in the file. */
+    if (strpbrk(url, "\t\n") != NULL || strpbrk(final_url, "\t\n") != NULL)
+        return;
+
+    pthread_mutex_lock(&(rc->mutex));
+    redirect_cache_add_int(rc, url, final_url, rc->ttl>0?(int64_t)time(NULL)+rc->ttl:0);
+    rc->dirty = true;
+    pthread_mutex_unlock(&(rc->mutex));
+}
+
+void redirect_cache_remove(redirect_cache_t *rc, const char *url)
+{
+    if (rc == NULL || str_isempty(url))
+        return;
+
+    pthread_mutex_lock(&(rc->mutex));
+    if (htable_remove(rc->urls, url))
+        rc->dirty = true;
+    pthread_mutex_unlock(&(rc->mutex));
+}
@@ -0,0 +1,103 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __REDIRECT_CACHE_H__
+#define __REDIRECT_CACHE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! \addtogroup redirect_cache Redirect Cache
+ *
+ * Where URLs ended up after following redirects. Episode URLs usually
+ * go through several tracking redirects before reaching the server
+ * with the file. Remembering the final URL lets later requests for the
+ * same episode skip them.
+ *
+ * Thread safe.
+ *
+ * @{
+ */
+
+struct redirect_cache;
+typedef struct redirect_cache redirect_cache_t;
+
+/* - - - - */
+
+/*! Create a redirect cache.
+ *
+ * \param[in] filename File to load from and save to. NULL to only
+ *                     keep redirects in memory.
+ * \param[in] ttl      Seconds a saved redirect is used for. Only used
+ *                     with a filename. Entries in the file that are
+ *                     older are dropped.
+ *
+ * \return Cache.
+ */
+redirect_cache_t *redirect_cache_create(const char *filename, int64_t ttl);
+
+/*! Destroy a redirect cache.
+ *
+ * \param[in,out] rc Cache.
+ */
+void redirect_cache_destroy(redirect_cache_t *rc);
+
+/*! Save the cache to its file.
+ *
+ * Does nothing if the cache doesn't have a file or hasn't changed.
+ *
+ * \param[in] rc Cache.
+ *
+ * \return true on success, otherwise false.
+ */
+bool redirect_cache_save(redirect_cache_t *rc);
+
+/*! Get where a URL redirects to.
+ *
+ * \param[in] rc  Cache.
+ * \param[in] url URL.
+ *
+ * \return Final URL. NULL if not known.
+ */
+char *redirect_cache_get(redirect_cache_t *rc, const char *url);
+
+/*! Record where a URL redirects to.
+ *
+ * \param[in,out] rc        Cache.
+ * \param[in]     url       URL.
+ * \param[in]     final_url URL after following redirects. If this is
+ *                          the same as url any cached entry is removed.
+ */
+void redirect_cache_put(redirect_cache_t *rc, const char *url, const char *final_url);
+
+/*! Forget where a URL redirects to.
+ *
+ * \param[in,out] rc  Cache.
+ * \param[in]     url URL.
+ */
+void redirect_cache_remove(redirect_cache_t *rc, const char *url);
+
+/*! @}
+ */
+
+#endif /* __REDIRECT_CACHE_H__ */
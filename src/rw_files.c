@@ -21,19 +21,43 @@
  * THE SOFTWARE
  */
 
+/* fallocate, copy_file_range. The *at family of functions. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+#endif
+
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #ifndef _WIN32
-#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <sys/ioctl.h>
+#  include <sys/mman.h>
+#  include <sys/statvfs.h>
 #  include <unistd.h>
 #endif
 
+#ifdef __linux__
+#  include <linux/fs.h>
+#endif
+
 #include "str_builder.h"
 #include "str_helpers.h"
 #include "rw_files.h"
+#include "xmem.h"
+
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#  define RW_HAVE_COPY_FILE_RANGE 1
+#endif
+
+#ifndef S_ISDIR
+#  define S_ISDIR(m) (((m) & S_IFMT) == S_IFDIR)
+#endif
 
 /* - - - - */
 
@@ -43,6 +67,68 @@ const char SEP = '\\';
 const char SEP = '/';
 #endif
 
+struct rw_map {
+    unsigned char *data;
+    size_t         len;
+    bool           mapped; /*!< data is from mmap instead of being allocated. */
+};
+
+/* - - - - */
+
+/* Read the rest of a file into a single buffer. hint is the expected size
+ * so in the common case the data is read with a single call. The buffer is
+ * always NULL terminated so it can be used as a string. */
+static unsigned char *rw_read_fp(FILE *f, size_t hint, size_t *len)
+{
+    unsigned char *out;
+    size_t         alloced;
+    size_t         r;
+
+    *len    = 0;
+    alloced = hint+1;
+    out     = xmalloc(alloced);
+
+    while (1) {
+        r     = fread(out+*len, 1, alloced-*len-1, f);
+        *len += r;
+        if (*len < alloced-1)
+            break;
+
+        /* The file grew since we got its size. */
+        alloced <<= 1;
+        out       = xrealloc(out, alloced);
+    }
+
+    if (ferror(f)) {
+        xfree(out);
+        *len = 0;
+        return NULL;
+    }
+
+    out[*len] = '\0';
+    return out;
+}
+
+/* Size of an open file. 0 if it can't be determined. */
+static size_t rw_fp_size(FILE *f)
+{
+#ifndef _WIN32
+    struct stat st;
+
+    if (fstat(fileno(f), &st) != 0 || st.st_size < 0)
+        return 0;
+    return (size_t)st.st_size;
+#else
+    long size;
+
+    if (fseek(f, 0L, SEEK_END) != 0)
+        return 0;
+    size = ftell(f);
+    fseek(f, 0L, SEEK_SET);
+    return size<0?0:(size_t)size;
+#endif
+}
+
 /* - - - - */
 
 char *rw_join_path(size_t n_args, ...)
@@ -88,11 +174,8 @@ char *rw_join_path(size_t n_args, ...)
 unsigned char *rw_read_file(const char *filename, size_t *len)
 {
     FILE          *f;
-    str_builder_t *sb;
-    char          *out;
-    char           temp[256];
+    unsigned char *out;
     size_t         mylen;
-    size_t         r;
 
     if (len == NULL)
         len = &mylen;
@@ -104,23 +187,83 @@ unsigned char *rw_read_file(const char *filename, size_t *len)
     f = fopen(filename, "rb");
     if (f == NULL)
         return NULL;
-    
-    sb = str_builder_create();
-    do {
-        r = fread(temp, sizeof(*temp), sizeof(temp), f);
-        str_builder_add_sub_str(sb, temp, r);
-        *len += r;
-    } while (r > 0);
+
+    out = rw_read_fp(f, rw_fp_size(f), len);
     fclose(f);
+    return out;
+}
 
-    if (str_builder_len(sb) == 0) {
-        str_builder_destroy(sb);
-        return str_strdup_safe("");
+rw_map_t *rw_map_file(const char *filename)
+{
+    rw_map_t *map;
+    FILE     *f;
+    size_t    size;
+
+    if (str_isempty(filename))
+        return NULL;
+
+    f = fopen(filename, "rb");
+    if (f == NULL)
+        return NULL;
+
+    map  = xcalloc(1, sizeof(*map));
+    size = rw_fp_size(f);
+
+#ifndef _WIN32
+    if (size > 0) {
+        map->data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+        if (map->data != MAP_FAILED) {
+            /* We're only ever going to read this front to back. */
+            posix_madvise(map->data, size, POSIX_MADV_SEQUENTIAL);
+            map->len    = size;
+            map->mapped = true;
+            fclose(f);
+            return map;
+        }
+        map->data = NULL;
     }
+#endif
 
-    out = str_builder_dump(sb, NULL);
-    str_builder_destroy(sb);
-    return (unsigned char *)out;
+    /* Can't map it (or it's a special file that doesn't have
+     * a size) so read it in instead. */
+    map->data = rw_read_fp(f, size, &map->len);
+    fclose(f);
+    if (map->data == NULL) {
+        xfree(map);
+        return NULL;
+    }
+    return map;
+}
+
+void rw_unmap_file(rw_map_t *map)
+{
+    if (map == NULL)
+        return;
+
+#ifndef _WIN32
+    if (map->mapped) {
+        munmap(map->data, map->len);
+        xfree(map);
+        return;
+    }
+#endif
+
+    xfree(map->data);
+    xfree(map);
+}
+
+const unsigned char *rw_map_data(const rw_map_t *map)
+{
+    if (map == NULL || map->len == 0)
+        return NULL;
+    return map->data;
+}
+
+size_t rw_map_len(const rw_map_t *map)
+{
+    if (map == NULL)
+        return 0;
+    return map->len;
 }
 
 size_t rw_write_file(const char *filename, const unsigned char *data, size_t len, bool append)
@@ -151,6 +294,31 @@ size_t rw_write_file(const char *filename, const unsigned char *data, size_t len
     return wrote;
 }
 
+bool rw_replace_file(const char *filename, const unsigned char *data, size_t len)
+{
+    str_builder_t *sb;
+    char          *tmpname;
+    bool           ret;
+
+    if (str_isempty(filename) || data == NULL)
+        return false;
+
+    sb = str_builder_create();
+    str_builder_add_str(sb, filename);
+    str_builder_add_str(sb, ".tmp");
+    tmpname = str_builder_dump(sb, NULL);
+    str_builder_destroy(sb);
+
+    ret = rw_write_file(tmpname, data, len, false) == len;
+    if (ret)
+        ret = rw_rename(tmpname, filename, true);
+    if (!ret)
+        rw_file_unlink(tmpname);
+
+    xfree(tmpname);
+    return ret;
+}
+
 bool rw_create_dir(const char *name)
 {
     str_builder_t  *sb;
@@ -162,6 +330,14 @@ bool rw_create_dir(const char *name)
     if (str_isempty(name))
         return false;
 
+#ifndef _WIN32
+    /* Usually the parent exists so try without walking the path first. */
+    if (mkdir(name, 0774) == 0 || errno == EEXIST)
+        return true;
+    if (errno != ENOENT)
+        return false;
+#endif
+
     parts = str_split(name, strlen(name), SEP, &num_parts, 0);
     if (parts == NULL || num_parts == 0) {
         str_split_free(parts, num_parts);
@@ -218,30 +394,92 @@ done:
 
 bool rw_file_exists(const char *filename)
 {
-    FILE *f;
+    struct stat st;
 
-    f = fopen(filename, "rb+");
-    if (f == NULL)
+    if (str_isempty(filename) || stat(filename, &st) != 0)
         return false;
-
-    fclose(f);
-    return true;
+    return !S_ISDIR(st.st_mode);
 }
 
 int64_t rw_file_size(const char *filename)
 {
-    FILE    *f;
-    int64_t  size;
+    struct stat st;
 
-    f = fopen(filename, "rb");
-    if (f == NULL)
+    if (str_isempty(filename) || stat(filename, &st) != 0 || S_ISDIR(st.st_mode))
         return -1;
+    return (int64_t)st.st_size;
+}
 
-    fseek(f, 0L, SEEK_END);
-    size = ftell(f);
+#ifndef _WIN32
+bool rw_file_exists_at(int dirfd, const char *name)
+{
+    struct stat st;
 
-    fclose(f);
-    return size;
+    if (str_isempty(name) || fstatat(dirfd, name, &st, 0) != 0)
+        return false;
+    return !S_ISDIR(st.st_mode);
+}
+
+int64_t rw_file_size_at(int dirfd, const char *name)
+{
+    struct stat st;
+
+    if (str_isempty(name) || fstatat(dirfd, name, &st, 0) != 0 || S_ISDIR(st.st_mode))
+        return -1;
+    return (int64_t)st.st_size;
+}
+#endif
+
+int64_t rw_fd_size(int fd)
+{
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) != 0)
+        return -1;
+    return (int64_t)st.st_size;
+}
+
+rw_prealloc_t rw_fd_preallocate(int fd, int64_t offset, int64_t len)
+{
+    if (fd < 0 || offset < 0)
+        return RW_PREALLOC_UNSUPPORTED;
+    if (len <= 0)
+        return RW_PREALLOC_OK;
+
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    /* posix_fallocate isn't used because it changes the file size. The size
+     * of a partial download is how much has been downloaded so it has to
+     * only grow as data is written. */
+    while (fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)len) != 0) {
+        if (errno == EINTR)
+            continue;
+        if (errno == ENOSPC || errno == EDQUOT || errno == EFBIG)
+            return RW_PREALLOC_NOSPACE;
+        /* Not supported by the file system. */
+        return RW_PREALLOC_UNSUPPORTED;
+    }
+    return RW_PREALLOC_OK;
+#else
+    return RW_PREALLOC_UNSUPPORTED;
+#endif
+}
+
+int64_t rw_free_space(const char *path)
+{
+#ifdef _WIN32
+    ULARGE_INTEGER avail;
+
+    if (!GetDiskFreeSpaceEx(path, &avail, NULL, NULL))
+        return -1;
+    return (int64_t)avail.QuadPart;
+#else
+    struct statvfs st;
+
+    if (statvfs(path, &st) != 0)
+        return -1;
+    /* f_bavail excludes blocks only root can use. */
+    return (int64_t)st.f_bavail * (int64_t)st.f_frsize;
+#endif
 }
 
 bool rw_file_unlink(const char *filename)
@@ -278,3 +516,231 @@ bool rw_rename(const char *cur_filename, const char *new_filename, bool overwrit
 
     return false;
 }
+
+#ifndef _WIN32
+int rw_dir_open(const char *path)
+{
+    if (str_isempty(path))
+        return -1;
+    return open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+}
+
+int rw_file_open_at(int dirfd, const char *name, bool truncate)
+{
+    if (str_isempty(name))
+        return -1;
+    return openat(dirfd, name, O_WRONLY|O_CREAT|O_CLOEXEC|(truncate?O_TRUNC:0), 0666);
+}
+
+int rw_file_open_read(const char *filename)
+{
+    if (str_isempty(filename))
+        return -1;
+    return open(filename, O_RDONLY|O_CLOEXEC);
+}
+
+int rw_file_open_read_at(int dirfd, const char *name)
+{
+    if (str_isempty(name))
+        return -1;
+    return openat(dirfd, name, O_RDONLY|O_CLOEXEC);
+}
+
+unsigned char *rw_read_file_at(int dirfd, const char *name, size_t *len)
+{
+    FILE          *f;
+    unsigned char *out;
+    size_t         mylen;
+    int            fd;
+
+    if (len == NULL)
+        len = &mylen;
+    *len = 0;
+
+    fd = rw_file_open_read_at(dirfd, name);
+    if (fd == -1)
+        return NULL;
+
+    f = fdopen(fd, "rb");
+    if (f == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    out = rw_read_fp(f, rw_fp_size(f), len);
+    fclose(f);
+    return out;
+}
+
+bool rw_write_file_at(int dirfd, const char *name, const unsigned char *data, size_t len)
+{
+    str_builder_t *sb;
+    char          *tmpname;
+    ssize_t        w;
+    int            fd;
+    bool           ret = true;
+
+    if (str_isempty(name) || (data == NULL && len != 0))
+        return false;
+
+    /* Written to a temporary file and renamed over the real
+     * one so readers never see a partially written file. */
+    sb = str_builder_create();
+    str_builder_add_str(sb, name);
+    str_builder_add_str(sb, ".tmp");
+    tmpname = str_builder_dump(sb, NULL);
+    str_builder_destroy(sb);
+
+    fd = rw_file_open_at(dirfd, tmpname, true);
+    if (fd == -1) {
+        xfree(tmpname);
+        return false;
+    }
+
+    while (len > 0) {
+        w = write(fd, data, len);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0) {
+            ret = false;
+            break;
+        }
+        data += w;
+        len  -= (size_t)w;
+    }
+
+    if (close(fd) != 0)
+        ret = false;
+    if (ret)
+        ret = rw_rename_at(dirfd, tmpname, dirfd, name);
+    if (!ret)
+        unlinkat(dirfd, tmpname, 0);
+
+    xfree(tmpname);
+    return ret;
+}
+
+bool rw_file_unlink_at(int dirfd, const char *name)
+{
+    if (str_isempty(name))
+        return false;
+    return unlinkat(dirfd, name, 0)==0?true:false;
+}
+
+bool rw_rename_at(int cur_dirfd, const char *cur_name, int new_dirfd, const char *new_name)
+{
+    if (str_isempty(cur_name) || str_isempty(new_name))
+        return false;
+    /* Replaces new_name if it exists. */
+    return renameat(cur_dirfd, cur_name, new_dirfd, new_name)==0?true:false;
+}
+
+bool rw_fd_copy(int out_fd, int in_fd)
+{
+    unsigned char  buf[64*1024];
+    unsigned char *p;
+    ssize_t        r;
+    ssize_t        w;
+#ifdef RW_HAVE_COPY_FILE_RANGE
+    bool           copied = false;
+#endif
+
+    if (out_fd < 0 || in_fd < 0)
+        return false;
+
+#ifdef RW_HAVE_COPY_FILE_RANGE
+    /* Copy in the kernel. The file system can offload or reflink the
+     * copy so the data might not pass through memory at all. */
+    while ((r = copy_file_range(in_fd, NULL, out_fd, NULL, 1024*1024*1024, 0)) > 0)
+        copied = true;
+    if (r == 0)
+        return true;
+    /* Not supported between these files. Fall back to copying only if
+     * nothing has been copied yet. */
+    if (copied || (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP))
+        return false;
+#endif
+
+    while (1) {
+        r = read(in_fd, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return r == 0;
+
+        p = buf;
+        while (r > 0) {
+            w = write(out_fd, p, (size_t)r);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0)
+                return false;
+            p += w;
+            r -= w;
+        }
+    }
+}
+
+bool rw_fd_clone(int out_fd, int in_fd)
+{
+    if (out_fd < 0 || in_fd < 0)
+        return false;
+#ifdef FICLONE
+    return ioctl(out_fd, FICLONE, in_fd)==0?true:false;
+#else
+    errno = EOPNOTSUPP;
+    return false;
+#endif
+}
+
+bool rw_link_at(const char *cur_filename, int new_dirfd, const char *new_name)
+{
+    if (str_isempty(cur_filename) || str_isempty(new_name))
+        return false;
+    return linkat(AT_FDCWD, cur_filename, new_dirfd, new_name, 0)==0?true:false;
+}
+
+rw_map_t *rw_map_file_rw(const char *filename, size_t len)
+{
+    rw_map_t    *map;
+    struct stat  st;
+    int          fd;
+
+    if (str_isempty(filename))
+        return NULL;
+
+    fd = open(filename, O_RDWR|O_CREAT|O_CLOEXEC, 0644);
+    if (fd == -1)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || (st.st_size < (off_t)len && ftruncate(fd, (off_t)len) != 0)) {
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size > (off_t)len)
+        len = (size_t)st.st_size;
+    if (len == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    map       = xcalloc(1, sizeof(*map));
+    map->data = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map->data == MAP_FAILED) {
+        xfree(map);
+        return NULL;
+    }
+    map->len    = len;
+    map->mapped = true;
+
+    return map;
+}
+
+unsigned char *rw_map_data_rw(rw_map_t *map)
+{
+    if (map == NULL || !map->mapped)
+        return NULL;
+    return map->data;
+}
+#endif
@@ -54,6 +54,46 @@ char *rw_join_path(size_t n_args, ...);
  */
 unsigned char *rw_read_file(const char *filename, size_t *len);
 
+/*! Read only view of a file's contents. */
+struct rw_map;
+typedef struct rw_map rw_map_t;
+
+/*! Map a file into memory.
+ *
+ * The file is mapped with mmap when possible. Otherwise it is read
+ * into memory with a single read.
+ *
+ * \param[in] filename Path to and name of a file to map.
+ *
+ * \return Map. NULL on error. An empty file returns a valid
+ *         map with a length of 0.
+ */
+rw_map_t *rw_map_file(const char *filename);
+
+/*! Release a mapped file.
+ *
+ * \param[in,out] map Map.
+ */
+void rw_unmap_file(rw_map_t *map);
+
+/*! Data in a mapped file.
+ *
+ * The data is not NULL terminated.
+ *
+ * \param[in] map Map.
+ *
+ * \return Data. NULL if the file is empty.
+ */
+const unsigned char *rw_map_data(const rw_map_t *map);
+
+/*! Length of a mapped file.
+ *
+ * \param[in] map Map.
+ *
+ * \return Length.
+ */
+size_t rw_map_len(const rw_map_t *map);
+
 /*! Write data to a file.
  *
  * Will create the file if it does not exist.
@@ -67,6 +107,19 @@ unsigned char *rw_read_file(const char *filename, size_t *len);
  */
 size_t rw_write_file(const char *filename, const unsigned char *data, size_t len, bool append);
 
+/*! Replace the contents of a file.
+ *
+ * The data is written to a temporary file which is renamed over the
+ * file. Readers see either the old or the new contents, never a mix.
+ *
+ * \param[in] filename Path to and name of the file.
+ * \param[in] data     Data to write to the file.
+ * \param[in] len      Length of data to write.
+ *
+ * \return true on success, otherwise false.
+ */
+bool rw_replace_file(const char *filename, const unsigned char *data, size_t len);
+
 /*! Create a directory on disk.
  *
  * A relative path will create relative to cwd.
@@ -78,6 +131,9 @@ size_t rw_write_file(const char *filename, const unsigned char *data, size_t len
 bool rw_create_dir(const char *name);
 
 /*! Check if a file exists.
+ *
+ * Only looks at the file's metadata. Files that can't be opened
+ * for writing still exist. Directories are not files.
  *
  * \param[in] filename File path and name. Can be relative.
  *
@@ -93,6 +149,68 @@ bool rw_file_exists(const char *filename);
  */
 int64_t rw_file_size(const char *filename);
 
+#ifndef _WIN32
+/*! Check if a file exists in an open directory.
+ *
+ * Avoids resolving the directory's path again.
+ *
+ * \param[in] dirfd Open directory.
+ * \param[in] name  File name relative to the directory.
+ *
+ * \return true on success, otherwise false.
+ */
+bool rw_file_exists_at(int dirfd, const char *name);
+
+/*! Get the size of a file in an open directory.
+ *
+ * \param[in] dirfd Open directory.
+ * \param[in] name  File name relative to the directory.
+ *
+ * \return Size of file. -1 if file does not exist.
+ */
+int64_t rw_file_size_at(int dirfd, const char *name);
+#endif
+
+/*! Get the size of an open file.
+ *
+ * \param[in] fd Open file descriptor.
+ *
+ * \return Size of file. -1 on error.
+ */
+int64_t rw_fd_size(int fd);
+
+/*! Result of preallocating space. */
+typedef enum {
+    RW_PREALLOC_OK = 0,      /*!< The space is allocated to the file. */
+    RW_PREALLOC_UNSUPPORTED, /*!< Nothing was allocated. The system or file system
+                                  doesn't support preallocating or it failed for
+                                  a reason other than running out of space. */
+    RW_PREALLOC_NOSPACE      /*!< There isn't enough space. */
+} rw_prealloc_t;
+
+/*! Reserve disk space for data that will be written to a file.
+ *
+ * The file size is not changed. Only blocks are allocated so the data
+ * can be written without fragmenting and without running out of space
+ * part way through.
+ *
+ * \param[in] fd     Open file descriptor.
+ * \param[in] offset Offset the data will start at.
+ * \param[in] len    Length of the data.
+ *
+ * \return Whether the space was allocated. Nothing needing to be
+ *         allocated counts as allocated.
+ */
+rw_prealloc_t rw_fd_preallocate(int fd, int64_t offset, int64_t len);
+
+/*! Disk space available to the user on the file system containing a path.
+ *
+ * \param[in] path Path to a file or directory. Must exist.
+ *
+ * \return Number of bytes free. -1 on error.
+ */
+int64_t rw_free_space(const char *path);
+
 /*! Delete a file.
  *
  * \param[in] filename File path and name. Can be relative.
@@ -112,4 +230,146 @@ bool rw_file_unlink(const char *filename);
  */
 bool rw_rename(const char *cur_filename, const char *new_filename, bool overwrite);
 
+#ifndef _WIN32
+/*! Open a directory.
+ *
+ * The descriptor can be used with the *_at functions.
+ *
+ * \param[in] path Path to the directory.
+ *
+ * \return Descriptor. -1 on error.
+ */
+int rw_dir_open(const char *path);
+
+/*! Open a file in a directory for writing.
+ *
+ * The file is created if it doesn't exist.
+ *
+ * \param[in] dirfd    Open directory.
+ * \param[in] name     File name relative to the directory.
+ * \param[in] truncate Truncate the file if it exists.
+ *
+ * \return Descriptor. -1 on error.
+ */
+int rw_file_open_at(int dirfd, const char *name, bool truncate);
+
+/*! Open a file for reading.
+ *
+ * \param[in] filename File name.
+ *
+ * \return Descriptor. -1 on error.
+ */
+int rw_file_open_read(const char *filename);
+
+/*! Open a file in a directory for reading.
+ *
+ * \param[in] dirfd Open directory.
+ * \param[in] name  File name relative to the directory.
+ *
+ * \return Descriptor. -1 on error.
+ */
+int rw_file_open_read_at(int dirfd, const char *name);
+
+/*! Read a file in a directory.
+ *
+ * \param[in]  dirfd Open directory.
+ * \param[in]  name  File name relative to the directory.
+ * \param[out] len   Length of the data read. Can be NULL.
+ *
+ * \return NULL terminated data. NULL on error.
+ */
+unsigned char *rw_read_file_at(int dirfd, const char *name, size_t *len);
+
+/*! Replace a file in a directory.
+ *
+ * The data is written to a temporary file which is renamed over the
+ * file. The file either has its old contents or all of the new contents.
+ *
+ * \param[in] dirfd Open directory.
+ * \param[in] name  File name relative to the directory.
+ * \param[in] data  Data to write.
+ * \param[in] len   Length of data.
+ *
+ * \return true on success, otherwise false.
+ */
+bool rw_write_file_at(int dirfd, const char *name, const unsigned char *data, size_t len);
+
+/*! Delete a file in a directory.
+ *
+ * \param[in] dirfd Open directory.
+ * \param[in] name  File name relative to the directory.
+ *
+ * \return true on success, otherwise false.
+ */
+bool rw_file_unlink_at(int dirfd, const char *name);
+
+/*! Rename a file between open directories.
+ *
+ * Replaces the new file if it exists. Both directories must be on the
+ * same file system.
+ *
+ * \param[in] cur_dirfd Directory containing the file.
+ * \param[in] cur_name  Current name of the file.
+ * \param[in] new_dirfd Directory to move the file to. Can be the same as cur_dirfd.
+ * \param[in] new_name  New name of the file.
+ *
+ * \return true on success, otherwise false.
+ */
+bool rw_rename_at(int cur_dirfd, const char *cur_name, int new_dirfd, const char *new_name);
+
+/*! Copy the rest of one file to another.
+ *
+ * Copies from the current position of in_fd to the current position of
+ * out_fd. The copy is done by the kernel when possible.
+ *
+ * \param[in] out_fd File to write to.
+ * \param[in] in_fd  File to read from.
+ *
+ * \return true on success, otherwise false.
+ */
+bool rw_fd_copy(int out_fd, int in_fd);
+
+/*! Make one file share the data of another.
+ *
+ * The data isn't copied. Both files refer to the same blocks until one
+ * of them is changed. Only supported by some file systems (Btrfs, XFS).
+ *
+ * \param[in] out_fd File to replace the contents of.
+ * \param[in] in_fd  File to share the data of.
+ *
+ * \return true on success, otherwise false.
+ */
+bool rw_fd_clone(int out_fd, int in_fd);
+
+/*! Create a hard link to a file.
+ *
+ * \param[in] cur_filename Existing file.
+ * \param[in] new_dirfd    Open directory to create the link in.
+ * \param[in] new_name     Name of the link. Must not exist.
+ *
+ * \return true on success, otherwise false.
+ */
+bool rw_link_at(const char *cur_filename, int new_dirfd, const char *new_name);
+
+/*! Map a file for reading and writing.
+ *
+ * Changes to the data are written back to the file. Unmap
+ * with rw_unmap_file.
+ *
+ * \param[in] filename File name. Created if it doesn't exist.
+ * \param[in] len      Minimum length. The file is grown if it's shorter.
+ *
+ * \return Map. NULL on error or if the file is empty.
+ */
+rw_map_t *rw_map_file_rw(const char *filename, size_t len);
+
+/*! Writable data of a map created with rw_map_file_rw.
+ *
+ * \param[in] map Map.
+ *
+ * \return Data.
+ */
+unsigned char *rw_map_data_rw(rw_map_t *map);
+#endif
+
 #endif /* __RW_FILES_H__ */
@@ -21,6 +21,7 @@
  * THE SOFTWARE
  */
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -88,7 +89,7 @@ static char *settings_get_dir(void)
         return NULL;
     }
     if (iscfg) {
-        path = strdup(home);
+        path = xstrdup(home);
     } else {
         path = rw_join_path(2, home, ".config");
     }
@@ -101,7 +102,7 @@ static char *settings_get_dir(void)
 
 bool settings_load(char *error, size_t errlen)
 {
-    char      *sxml = NULL;
+    rw_map_t  *sxml = NULL;
     char      *text;
     char      *path;
     xmlDocPtr  doc  = NULL;
@@ -122,18 +123,22 @@ bool settings_load(char *error, size_t errlen)
         goto error;
     }
 
-    settings->last_dl_file = rw_join_path(2, path, "lastdl");
+    settings->last_dl_file    = rw_join_path(2, path, "lastdl");
+    settings->dedupe_file     = rw_join_path(2, path, "dedupe");
+    settings->ep_state_file   = rw_join_path(2, path, "episodes");
+    settings->feed_state_file = rw_join_path(2, path, "feeds");
+    settings->redirect_file   = rw_join_path(2, path, "redirects");
 
     text = rw_join_path(2, path, "settings.xml");
-    sxml = (char *)rw_read_file(text, NULL);
-    if (str_isempty(sxml)) {
+    sxml = rw_map_file(text);
+    if (rw_map_len(sxml) == 0 || rw_map_len(sxml) > INT_MAX) {
         snprintf(error, errlen, "Could not read settings file: '%s'", text);
         xfree(text);
         goto error;
     }
     xfree(text);
 
-    doc = xmlParseMemory(sxml, strlen(sxml));
+    doc = xmlReadMemory((const char *)rw_map_data(sxml), (int)rw_map_len(sxml), NULL, NULL, XML_PARSE_NONET);
     if (doc == NULL) {
         snprintf(error, errlen, "Failed to parse settings xml");
         goto error;
@@ -155,6 +160,13 @@ bool settings_load(char *error, size_t errlen)
     }
     settings->casts_xml_file = text;
 
+    text = get_xml_text("/poddown/location/staging_dir", doc, NULL);
+    if (str_isempty(text)) {
+        xfree(text);
+        text = NULL;
+    }
+    settings->staging_dir = text;
+
     text = get_xml_text("/poddown/download/recent", doc, NULL);
     lval = strtoll(str_safe(text), NULL, 10);
     xfree(text);
@@ -168,12 +180,49 @@ bool settings_load(char *error, size_t errlen)
         settings->ignore_last_modified = str_istrue(text);
     xfree(text);
 
+    text = get_xml_text("/poddown/download/adaptive_polling", doc, NULL);
+    settings->adaptive_polling = str_istrue(text);
+    xfree(text);
+
+    text = get_xml_text("/poddown/download/max_poll_hours", doc, NULL);
+    lval = strtoll(str_safe(text), NULL, 10);
+    xfree(text);
+    if (lval <= 0)
+        lval = 24;
+    settings->max_poll_interval = (int64_t)lval*60*60;
+
     text = get_xml_text("/poddown/download/keep_partial", doc, NULL);
     settings->keep_partial = true;
     if (!str_isempty(text))
         settings->keep_partial = str_istrue(text);
     xfree(text);
 
+    text = get_xml_text("/poddown/download/max_attempts", doc, NULL);
+    lval = str_isempty(text)?-1:strtoll(text, NULL, 10);
+    xfree(text);
+    if (lval < 0)
+        lval = 5;
+    settings->max_attempts = lval;
+
+    text = get_xml_text("/poddown/download/verify_resume_tail", doc, NULL);
+    settings->verify_resume_tail = str_istrue(text);
+    xfree(text);
+
+    text = get_xml_text("/poddown/download/checksums", doc, NULL);
+    settings->checksums = str_istrue(text);
+    xfree(text);
+
+    text = get_xml_text("/poddown/download/dedupe", doc, NULL);
+    settings->dedupe = str_istrue(text);
+    xfree(text);
+
+    text = get_xml_text("/poddown/download/redirect_cache_hours", doc, NULL);
+    lval = strtoll(str_safe(text), NULL, 10);
+    xfree(text);
+    if (lval < 0)
+        lval = 0;
+    settings->redirect_ttl = (int64_t)lval*60*60;
+
     text = get_xml_text("/poddown/download/allow_explicit", doc, NULL);
     settings->allow_explicit = true;
     if (!str_isempty(text))
@@ -194,12 +243,66 @@ bool settings_load(char *error, size_t errlen)
         lval = cpthread_get_num_procs()+1;
     settings->dlep_threads = lval;
 
+    text = get_xml_text("/poddown/tuning/probe_threads", doc, NULL);
+    lval = strtoll(str_safe(text), NULL, 10);
+    xfree(text);
+    if (lval <= 0)
+        lval = settings->dlep_threads*4;
+    settings->probe_threads = lval;
+
+    text = get_xml_text("/poddown/tuning/write_buffer_kb", doc, NULL);
+    lval = strtoll(str_safe(text), NULL, 10);
+    xfree(text);
+    if (lval <= 0)
+        lval = 1024;
+    settings->write_buffer_size = lval*1024;
+
+    text = get_xml_text("/poddown/tuning/write_buffers", doc, NULL);
+    lval = strtoll(str_safe(text), NULL, 10);
+    xfree(text);
+    if (lval <= 0)
+        lval = settings->dlep_threads*4;
+    settings->write_buffers = lval;
+
+    text = get_xml_text("/poddown/tuning/writer_threads", doc, NULL);
+    lval = strtoll(str_safe(text), NULL, 10);
+    xfree(text);
+    if (lval <= 0)
+        lval = 2;
+    settings->writer_threads = lval;
+
+    /* 0 is allowed and leaves nothing free. */
+    text = get_xml_text("/poddown/tuning/disk_reserve_mb", doc, NULL);
+    lval = str_isempty(text)?-1:strtoll(text, NULL, 10);
+    xfree(text);
+    if (lval < 0)
+        lval = 256;
+    settings->disk_reserve = (int64_t)lval*1024*1024;
+
+    text = get_xml_text("/poddown/tuning/io_uring", doc, NULL);
+    settings->use_io_uring = str_istrue(text);
+    xfree(text);
+
+    text = get_xml_text("/poddown/tuning/sync_episodes", doc, NULL);
+    settings->sync_episodes = str_istrue(text);
+    xfree(text);
+
+    text = get_xml_text("/poddown/tuning/drop_cache", doc, NULL);
+    settings->drop_cache = str_istrue(text);
+    xfree(text);
+
     text = get_xml_text("/poddown/tuning/update_lastdl_on_error", doc, NULL);
     settings->update_lastdl_on_error = true;
     if (!str_isempty(text))
         settings->update_lastdl_on_error = str_istrue(text);
     xfree(text);
 
+    text = get_xml_text("/poddown/tuning/print_stats", doc, NULL);
+    settings->print_stats = false;
+    if (!str_isempty(text))
+        settings->print_stats = str_istrue(text);
+    xfree(text);
+
 
     goto done;
 
@@ -209,7 +312,7 @@ error:
 done:
     if (doc != NULL)
         xmlFreeDoc(doc);
-    xfree(sxml);
+    rw_unmap_file(sxml);
     xfree(path);
     return ret;
 }
@@ -221,7 +324,12 @@ void settings_unload(void)
 
     xfree(settings->casts_xml_file);
     xfree(settings->cast_dl_dir);
+    xfree(settings->staging_dir);
     xfree(settings->last_dl_file);
+    xfree(settings->dedupe_file);
+    xfree(settings->ep_state_file);
+    xfree(settings->feed_state_file);
+    xfree(settings->redirect_file);
 
     xfree(settings);
     settings = NULL;
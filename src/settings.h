@@ -25,6 +25,7 @@
 #define __SETTINGS_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 /* - - - - */
@@ -32,14 +33,35 @@
 typedef struct {
     char   *casts_xml_file;
     char   *cast_dl_dir;
+    char   *staging_dir;
     char   *last_dl_file;
+    char   *dedupe_file;
+    char   *ep_state_file;
+    char   *feed_state_file;
+    char   *redirect_file;
     bool    allow_explicit;
     bool    keep_partial;
+    bool    verify_resume_tail;
+    bool    checksums;
+    bool    dedupe;
     bool    ignore_last_modified;
+    bool    adaptive_polling;
     bool    update_lastdl_on_error;
+    bool    print_stats;
+    bool    use_io_uring;
+    bool    sync_episodes;
+    bool    drop_cache;
     size_t  recent_num;
+    size_t  max_attempts;
     size_t  feed_threads;
     size_t  dlep_threads;
+    size_t  probe_threads;
+    size_t  write_buffer_size;
+    size_t  write_buffers;
+    size_t  writer_threads;
+    int64_t disk_reserve;
+    int64_t max_poll_interval;
+    int64_t redirect_ttl;
 } settings_t;
 
 /* - - - - */
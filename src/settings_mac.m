@@ -25,6 +25,7 @@
 #import <Foundation/Foundation.h>
 
 #include "settings_mac.h"
+#include "xmem.h"
     
 char *settings_get_dir_mac(void)
 {
@@ -36,5 +37,5 @@ char *settings_get_dir_mac(void)
     if (home == NULL) {
         return NULL;
     }
-    return strdup([home UTF8String]);
+    return xstrdup([home UTF8String]);
 }
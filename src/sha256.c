@@ -0,0 +1,324 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sha256.h"
+#include "str_builder.h"
+#include "xmem.h"
+
+/* - - - - */
+
+#define SHA256_BLOCK_LEN 64
+
+struct sha256 {
+    uint32_t      h[8];
+    uint64_t      len;                     /*!< Total bytes hashed. */
+    unsigned char buf[SHA256_BLOCK_LEN];   /*!< Partial block. len % 64 bytes are used. */
+};
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/* - - - - */
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32-(n))))
+
+static void sha256_block(uint32_t h[8], const unsigned char *p)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, hh;
+    uint32_t s0, s1, t1, t2;
+    size_t   i;
+
+    for (i=0; i<16; i++) {
+        w[i] = ((uint32_t)p[i*4] << 24) | ((uint32_t)p[i*4+1] << 16) | ((uint32_t)p[i*4+2] << 8) | (uint32_t)p[i*4+3];
+    }
+    for (i=16; i<64; i++) {
+        s0   = ROTR(w[i-15], 7) ^ ROTR(w[i-15], 18) ^ (w[i-15] >> 3);
+        s1   = ROTR(w[i-2], 17) ^ ROTR(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    a  = h[0];
+    b  = h[1];
+    c  = h[2];
+    d  = h[3];
+    e  = h[4];
+    f  = h[5];
+    g  = h[6];
+    hh = h[7];
+
+    for (i=0; i<64; i++) {
+        s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+        t1 = hh + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+        t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+
+        hh = g;
+        g  = f;
+        f  = e;
+        e  = d + t1;
+        d  = c;
+        c  = b;
+        b  = a;
+        a  = t1 + t2;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += hh;
+}
+
+static int sha256_hexval(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/* - - - - */
+
+sha256_t *sha256_create(void)
+{
+    sha256_t *ctx;
+
+    ctx = xcalloc(1, sizeof(*ctx));
+    sha256_reset(ctx);
+    return ctx;
+}
+
+void sha256_destroy(sha256_t *ctx)
+{
+    if (ctx == NULL)
+        return;
+    xfree(ctx);
+}
+
+void sha256_reset(sha256_t *ctx)
+{
+    if (ctx == NULL)
+        return;
+
+    memcpy(ctx->h, sha256_init, sizeof(ctx->h));
+    ctx->len = 0;
+}
+
+void sha256_update(sha256_t *ctx, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t               used;
+    size_t               n;
+
+    if (ctx == NULL || data == NULL || len == 0)
+        return;
+
+    used      = (size_t)(ctx->len % SHA256_BLOCK_LEN);
+    ctx->len += len;
+
+    /* Fill the partial block first. */
+    if (used > 0) {
+        n = SHA256_BLOCK_LEN - used;
+        if (n > len)
+            n = len;
+        memcpy(ctx->buf+used, p, n);
+        p   += n;
+        len -= n;
+        if (used+n < SHA256_BLOCK_LEN)
+            return;
+        sha256_block(ctx->h, ctx->buf);
+    }
+
+    /* Whole blocks are hashed directly from the input. */
+    while (len >= SHA256_BLOCK_LEN) {
+        sha256_block(ctx->h, p);
+        p   += SHA256_BLOCK_LEN;
+        len -= SHA256_BLOCK_LEN;
+    }
+
+    if (len > 0)
+        memcpy(ctx->buf, p, len);
+}
+
+uint64_t sha256_len(const sha256_t *ctx)
+{
+    if (ctx == NULL)
+        return 0;
+    return ctx->len;
+}
+
+void sha256_digest(const sha256_t *ctx, unsigned char out[SHA256_DIGEST_LEN])
+{
+    sha256_t      fin;
+    unsigned char pad[SHA256_BLOCK_LEN*2];
+    uint64_t      bits;
+    size_t        padlen;
+    size_t        used;
+    size_t        i;
+
+    if (ctx == NULL || out == NULL)
+        return;
+
+    /* Padding is applied to a copy so the hash can keep going. */
+    fin  = *ctx;
+    bits = ctx->len * 8;
+    used = (size_t)(ctx->len % SHA256_BLOCK_LEN);
+
+    padlen = (used < 56 ? 56 : 120) - used;
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (i=0; i<8; i++) {
+        pad[padlen+i] = (unsigned char)(bits >> (56 - (i*8)));
+    }
+    sha256_update(&fin, pad, padlen+8);
+
+    for (i=0; i<8; i++) {
+        out[i*4]   = (unsigned char)(fin.h[i] >> 24);
+        out[i*4+1] = (unsigned char)(fin.h[i] >> 16);
+        out[i*4+2] = (unsigned char)(fin.h[i] >> 8);
+        out[i*4+3] = (unsigned char)fin.h[i];
+    }
+}
+
+void sha256_digest_hex(const sha256_t *ctx, char out[SHA256_HEX_LEN])
+{
+    unsigned char digest[SHA256_DIGEST_LEN];
+    size_t        i;
+
+    if (ctx == NULL || out == NULL)
+        return;
+
+    sha256_digest(ctx, digest);
+    for (i=0; i<SHA256_DIGEST_LEN; i++) {
+        snprintf(out+(i*2), 3, "%02x", digest[i]);
+    }
+    out[SHA256_HEX_LEN-1] = '\0';
+}
+
+/* Format: "<8 words as hex>:<length>:<partial block as hex>". */
+char *sha256_state_save(const sha256_t *ctx)
+{
+    str_builder_t *sb;
+    char          *out;
+    char           temp[32];
+    size_t         used;
+    size_t         i;
+
+    if (ctx == NULL)
+        return NULL;
+
+    sb = str_builder_create();
+    for (i=0; i<8; i++) {
+        snprintf(temp, sizeof(temp), "%08" PRIx32, ctx->h[i]);
+        str_builder_add_str(sb, temp);
+    }
+    snprintf(temp, sizeof(temp), ":%" PRIu64 ":", ctx->len);
+    str_builder_add_str(sb, temp);
+
+    used = (size_t)(ctx->len % SHA256_BLOCK_LEN);
+    for (i=0; i<used; i++) {
+        snprintf(temp, sizeof(temp), "%02x", ctx->buf[i]);
+        str_builder_add_str(sb, temp);
+    }
+
+    out = str_builder_dump(sb, NULL);
+    str_builder_destroy(sb);
+    return out;
+}
+
+bool sha256_state_load(sha256_t *ctx, const char *state)
+{
+    const char *p;
+    char       *end;
+    uint64_t    len;
+    size_t      used;
+    size_t      i;
+    int         hi;
+    int         lo;
+
+    if (ctx == NULL)
+        return false;
+
+    sha256_reset(ctx);
+    if (state == NULL || strlen(state) < 64 || state[64] != ':')
+        return false;
+
+    for (i=0; i<64; i++) {
+        if (sha256_hexval(state[i]) < 0)
+            return false;
+    }
+
+    p   = state + 65;
+    len = strtoull(p, &end, 10);
+    if (end == p || *end != ':')
+        return false;
+    p = end + 1;
+
+    used = (size_t)(len % SHA256_BLOCK_LEN);
+    if (strlen(p) != used*2)
+        return false;
+
+    for (i=0; i<used; i++) {
+        hi = sha256_hexval(p[i*2]);
+        lo = sha256_hexval(p[i*2+1]);
+        if (hi < 0 || lo < 0) {
+            sha256_reset(ctx);
+            return false;
+        }
+        ctx->buf[i] = (unsigned char)((hi << 4) | lo);
+    }
+
+    for (i=0; i<8; i++) {
+        ctx->h[i] = 0;
+        for (hi=0; hi<8; hi++) {
+            ctx->h[i] = (ctx->h[i] << 4) | (uint32_t)sha256_hexval(state[(i*8)+hi]);
+        }
+    }
+    ctx->len = len;
+
+    return true;
+}
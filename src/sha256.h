@@ -0,0 +1,118 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*! \addtogroup sha256 SHA-256
+ *
+ * Incremental SHA-256 hashing. The state of a hash in progress can be
+ * saved and restored so hashing can continue across runs.
+ *
+ * @{
+ */
+
+#define SHA256_DIGEST_LEN 32
+/*! Size of a hex digest including the NULL terminator. */
+#define SHA256_HEX_LEN    ((SHA256_DIGEST_LEN*2)+1)
+
+struct sha256;
+typedef struct sha256 sha256_t;
+
+/* - - - - */
+
+/*! Create a hash.
+ *
+ * \return Hash.
+ */
+sha256_t *sha256_create(void);
+
+/*! Destroy a hash.
+ *
+ * \param[in,out] ctx Hash.
+ */
+void sha256_destroy(sha256_t *ctx);
+
+/*! Start over as if nothing has been hashed.
+ *
+ * \param[in,out] ctx Hash.
+ */
+void sha256_reset(sha256_t *ctx);
+
+/*! Add data to the hash.
+ *
+ * \param[in,out] ctx  Hash.
+ * \param[in]     data Data.
+ * \param[in]     len  Length of data.
+ */
+void sha256_update(sha256_t *ctx, const void *data, size_t len);
+
+/*! Number of bytes hashed.
+ *
+ * \param[in] ctx Hash.
+ *
+ * \return Length.
+ */
+uint64_t sha256_len(const sha256_t *ctx);
+
+/*! Get the digest of everything hashed so far.
+ *
+ * The hash can continue to be updated afterwards.
+ *
+ * \param[in]  ctx Hash.
+ * \param[out] out Digest.
+ */
+void sha256_digest(const sha256_t *ctx, unsigned char out[SHA256_DIGEST_LEN]);
+
+/*! Get the digest of everything hashed so far as a hex string.
+ *
+ * \param[in]  ctx Hash.
+ * \param[out] out NULL terminated lowercase hex digest.
+ */
+void sha256_digest_hex(const sha256_t *ctx, char out[SHA256_HEX_LEN]);
+
+/*! Save the state of the hash.
+ *
+ * \param[in] ctx Hash.
+ *
+ * \return String that can be passed to sha256_state_load.
+ */
+char *sha256_state_save(const sha256_t *ctx);
+
+/*! Restore a saved state.
+ *
+ * \param[in,out] ctx   Hash.
+ * \param[in]     state State from sha256_state_save.
+ *
+ * \return true if the state was valid. Otherwise false and the hash is reset.
+ */
+bool sha256_state_load(sha256_t *ctx, const char *state);
+
+/*! @}
+ */
+
+#endif /* __SHA256_H__ */
@@ -26,6 +26,7 @@
 #include <strings.h>
 
 #include "str_helpers.h"
+#include "xmem.h"
 
 /* - - - - */
 
@@ -60,7 +61,7 @@ const char *str_safe(const char *s)
 
 char *str_strdup_safe(const char *s)
 {
-    return strdup(str_safe(s));
+    return xstrdup(str_safe(s));
 }
 
 char **str_split(const char *in, size_t in_len, char delm, size_t *num_elm, size_t max)
@@ -73,7 +74,7 @@ char **str_split(const char *in, size_t in_len, char delm, size_t *num_elm, size
     if (in == NULL || in_len == 0 || num_elm == NULL)
         return NULL;
 
-    parsestr = malloc(in_len+1);
+    parsestr = xmalloc(in_len+1);
     memcpy(parsestr, in, in_len+1);
     parsestr[in_len] = '\0';
 
@@ -85,7 +86,7 @@ char **str_split(const char *in, size_t in_len, char delm, size_t *num_elm, size
             break;
     }
 
-    out    = malloc(*num_elm * sizeof(*out));
+    out    = xmalloc(*num_elm * sizeof(*out));
     out[0] = parsestr;
     for (i=0; i<in_len && cnt<*num_elm; i++) {
         if (parsestr[i] != delm)
@@ -105,6 +106,6 @@ void str_split_free(char **in, size_t num_elm)
     if (in == NULL)
         return;
     if (num_elm != 0)
-        free(in[0]);
-    free(in);
+        xfree(in[0]);
+    xfree(in);
 }
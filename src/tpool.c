@@ -22,6 +22,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 
 #include "tpool.h"
@@ -35,15 +36,22 @@
  *
  * It is a singly linked list acting as a FIFO queue. */
 struct tpool_work {
-    thread_func_t      func;  /*!< Function to be called. */
-    void              *arg;   /*!< Data to be passed to func. */
-    struct tpool_work *next;  /*!< Next work item in the queue. */
+    thread_func_t      func;     /*!< Function to be called. */
+    void              *arg;      /*!< Data to be passed to func. */
+    uint64_t           enqueued; /*!< Time the work was added to the queue. */
+    struct tpool_work *next;     /*!< Next work item in the queue. */
 };
 typedef struct tpool_work tpool_work_t;
 
+/* Maximum number of finished work objects kept for reuse. */
+#define TPOOL_WORK_FREE_MAX 256
+
 struct tpool {
     tpool_work_t    *work_first;   /*!< First work item in the work queue. */
     tpool_work_t    *work_last;    /*!< Last work item in the work queue. */
+    tpool_work_t    *work_free;    /*!< Finished work objects that can be reused.
+                                        Avoids an allocation for every piece of work. */
+    size_t           work_free_cnt; /*!< Number of objects in work_free. */
     pthread_mutex_t  work_mutex;   /*<! Mutex protecting inserting and removing work from the work queue. */
     pthread_cond_t   work_cond;    /*!< Conditional to signal when there is work to process. */
     pthread_cond_t   working_cond; /*!< Conditional to signal when there is no work processing.
@@ -51,24 +59,50 @@ struct tpool {
     size_t           working_cnt;  /*!< The number of threads processing work (Not waiting for work). */
     size_t           thread_cnt;   /*!< Total number of threads within the pool. */
     bool             stop;         /*!< Marker to tell the work threads to exit. */
+    /* Statistics. All protected by work_mutex. */
+    uint64_t         created;      /*!< Time the pool was created. */
+    size_t           worker_next;  /*!< Index to hand the next worker thread that starts. */
+    size_t           worker_cnt;   /*!< Number of entries in worker_busy. */
+    uint64_t        *worker_busy;  /*!< Time each worker has spent running work. */
+    tpool_stats_t    stats;        /*!< Counters and histograms. worker_busy_ns and elapsed_ns are unused. */
 };
 
 /* - - - - */
 
-static tpool_work_t *tpool_work_create(thread_func_t func, void *arg)
+/* Must be called with work_mutex locked. */
+static tpool_work_t *tpool_work_create(tpool_t *tp, thread_func_t func, void *arg)
 {
     tpool_work_t *work;
 
     if (func == NULL)
         return NULL;
 
-    work       = xcalloc(1, sizeof(*work));
+    if (tp->work_free != NULL) {
+        work          = tp->work_free;
+        tp->work_free = work->next;
+        tp->work_free_cnt--;
+    } else {
+        work = xcalloc(1, sizeof(*work));
+    }
     work->func = func;
     work->arg  = arg;
     work->next = NULL;
     return work;
 }
 
+/*!< Histogram bucket for an amount of time. */
+static size_t tpool_hist_bucket(uint64_t ns)
+{
+    uint64_t ms = ns / 1000000;
+    size_t   b  = 0;
+
+    while (ms > 0 && b < TPOOL_HIST_BUCKETS-1) {
+        ms >>= 1;
+        b++;
+    }
+    return b;
+}
+
 static void tpool_work_destroy(tpool_work_t *work)
 {
     if (work == NULL)
@@ -76,6 +110,22 @@ static void tpool_work_destroy(tpool_work_t *work)
     xfree(work);
 }
 
+/* Must be called with work_mutex locked. */
+static void tpool_work_recycle(tpool_t *tp, tpool_work_t *work)
+{
+    if (work == NULL)
+        return;
+
+    if (tp->work_free_cnt >= TPOOL_WORK_FREE_MAX) {
+        tpool_work_destroy(work);
+        return;
+    }
+
+    work->next    = tp->work_free;
+    tp->work_free = work;
+    tp->work_free_cnt++;
+}
+
 /*!< Pull the first work item out of the queue. */
 static tpool_work_t *tpool_work_get(tpool_t *tp)
 {
@@ -94,6 +144,7 @@ static tpool_work_t *tpool_work_get(tpool_t *tp)
     } else {
         tp->work_first = work->next;
     }
+    tp->stats.queue_depth--;
 
     return work;
 }
@@ -102,6 +153,14 @@ static void *tpool_worker(void *arg)
 {
     tpool_t      *tp = arg;
     tpool_work_t *work;
+    uint64_t      start;
+    uint64_t      wait;
+    uint64_t      run;
+    size_t        idx;
+
+    pthread_mutex_lock(&(tp->work_mutex));
+    idx = tp->worker_next++;
+    pthread_mutex_unlock(&(tp->work_mutex));
 
     while (1) {
         pthread_mutex_lock(&(tp->work_mutex));
@@ -117,6 +176,15 @@ static void *tpool_worker(void *arg)
         /* Try to pull work from the queue. */
         work = tpool_work_get(tp);
         tp->working_cnt++;
+        start = 0;
+        if (work != NULL) {
+            start = cpthread_time_ns();
+            wait  = start - work->enqueued;
+            tp->stats.wait_ns_total += wait;
+            if (wait > tp->stats.wait_ns_max)
+                tp->stats.wait_ns_max = wait;
+            tp->stats.wait_hist[tpool_hist_bucket(wait)]++;
+        }
         pthread_mutex_unlock(&(tp->work_mutex));
 
         /* Call the work function and let it process.
@@ -132,10 +200,21 @@ static void *tpool_worker(void *arg)
          */
         if (work != NULL) {
             work->func(work->arg);
-            tpool_work_destroy(work);
         }
 
         pthread_mutex_lock(&(tp->work_mutex));
+        if (work != NULL) {
+            run = cpthread_time_ns() - start;
+            tp->stats.completed++;
+            tp->stats.run_ns_total += run;
+            if (run > tp->stats.run_ns_max)
+                tp->stats.run_ns_max = run;
+            tp->stats.run_hist[tpool_hist_bucket(run)]++;
+            if (idx < tp->worker_cnt) {
+                tp->worker_busy[idx] += run;
+            }
+            tpool_work_recycle(tp, work);
+        }
         tp->working_cnt--;
         /* Since we're in a lock no work can be added or removed form the queue.
          * Also, the working_cnt can't be changed (except the thread holding the lock).
@@ -164,8 +243,11 @@ tpool_t *tpool_create(size_t num)
     if (num == 0)
         num = 2;
 
-    tp             = xcalloc(1, sizeof(*tp));
-    tp->thread_cnt = num;
+    tp              = xcalloc(1, sizeof(*tp));
+    tp->thread_cnt  = num;
+    tp->worker_cnt  = num;
+    tp->worker_busy = xcalloc(num, sizeof(*tp->worker_busy));
+    tp->created     = cpthread_time_ns();
 
     pthread_mutex_init(&(tp->work_mutex), NULL);
     pthread_cond_init(&(tp->work_cond), NULL);
@@ -199,7 +281,8 @@ void tpool_destroy(tpool_t *tp)
         tpool_work_destroy(work);
         work = work2;
     }
-    tp->work_first = NULL;
+    tp->work_first        = NULL;
+    tp->stats.queue_depth = 0;
     /* Tell the worker threads to stop. */
     tp->stop = true;
     pthread_cond_broadcast(&(tp->work_cond));
@@ -208,10 +291,19 @@ void tpool_destroy(tpool_t *tp)
     /* Wait for all threads to stop. */
     tpool_wait(tp);
 
+    /* Nothing can be recycled now that the threads have stopped. */
+    work = tp->work_free;
+    while (work != NULL) {
+        work2 = work->next;
+        tpool_work_destroy(work);
+        work = work2;
+    }
+
     pthread_mutex_destroy(&(tp->work_mutex));
     pthread_cond_destroy(&(tp->work_cond));
     pthread_cond_destroy(&(tp->working_cond));
 
+    xfree(tp->worker_busy);
     xfree(tp);
 }
 
@@ -224,11 +316,12 @@ bool tpool_add_work(tpool_t *tp, thread_func_t func, void *arg)
     if (tp == NULL)
         return false;
 
-    work = tpool_work_create(func, arg);
-    if (work == NULL)
+    if (func == NULL)
         return false;
 
     pthread_mutex_lock(&(tp->work_mutex));
+    work           = tpool_work_create(tp, func, arg);
+    work->enqueued = cpthread_time_ns();
     if (tp->work_first == NULL) {
         tp->work_first = work;
         tp->work_last  = tp->work_first;
@@ -236,6 +329,10 @@ bool tpool_add_work(tpool_t *tp, thread_func_t func, void *arg)
         tp->work_last->next = work;
         tp->work_last       = work;
     }
+    tp->stats.submitted++;
+    tp->stats.queue_depth++;
+    if (tp->stats.queue_depth > tp->stats.queue_depth_max)
+        tp->stats.queue_depth_max = tp->stats.queue_depth;
 
     pthread_cond_broadcast(&(tp->work_cond));
     pthread_mutex_unlock(&(tp->work_mutex));
@@ -261,3 +358,40 @@ void tpool_wait(tpool_t *tp)
     }
     pthread_mutex_unlock(&(tp->work_mutex));
 }
+
+/* - - - - */
+
+tpool_stats_t *tpool_stats_snapshot(tpool_t *tp)
+{
+    tpool_stats_t *stats;
+
+    if (tp == NULL)
+        return NULL;
+
+    stats = xcalloc(1, sizeof(*stats));
+
+    pthread_mutex_lock(&(tp->work_mutex));
+    memcpy(stats, &(tp->stats), sizeof(*stats));
+    stats->elapsed_ns     = cpthread_time_ns() - tp->created;
+    stats->worker_cnt     = tp->worker_cnt;
+    stats->worker_busy_ns = xcalloc(tp->worker_cnt, sizeof(*stats->worker_busy_ns));
+    memcpy(stats->worker_busy_ns, tp->worker_busy, tp->worker_cnt*sizeof(*stats->worker_busy_ns));
+    pthread_mutex_unlock(&(tp->work_mutex));
+
+    return stats;
+}
+
+void tpool_stats_destroy(tpool_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+    xfree(stats->worker_busy_ns);
+    xfree(stats);
+}
+
+double tpool_stats_worker_busy(const tpool_stats_t *stats, size_t idx)
+{
+    if (stats == NULL || idx >= stats->worker_cnt || stats->elapsed_ns == 0)
+        return 0;
+    return (double)stats->worker_busy_ns[idx] / (double)stats->elapsed_ns;
+}
@@ -26,6 +26,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /*! \addtogroup thread_pool Thread Pool
  *
@@ -41,6 +42,30 @@ typedef struct tpool tpool_t;
  */
 typedef void (*thread_func_t)(void *arg);
 
+/*! Number of buckets in the wait and run time histograms.
+ *
+ * Bucket 0 holds times under 1 ms. Bucket i holds times in [2^(i-1), 2^i) ms.
+ * The last bucket holds everything larger.
+ */
+#define TPOOL_HIST_BUCKETS 24
+
+/*! Snapshot of pool statistics. */
+typedef struct {
+    uint64_t  submitted;                     /*!< Work items added to the pool. */
+    uint64_t  completed;                     /*!< Work items that finished running. */
+    size_t    queue_depth;                   /*!< Work items currently waiting in the queue. */
+    size_t    queue_depth_max;               /*!< Largest the queue has been. */
+    uint64_t  wait_ns_total;                 /*!< Total time work spent waiting in the queue. */
+    uint64_t  wait_ns_max;                   /*!< Longest time a work item waited in the queue. */
+    uint64_t  run_ns_total;                  /*!< Total time spent running work. */
+    uint64_t  run_ns_max;                    /*!< Longest time a work item ran. */
+    uint64_t  wait_hist[TPOOL_HIST_BUCKETS]; /*!< Queue wait time histogram. */
+    uint64_t  run_hist[TPOOL_HIST_BUCKETS];  /*!< Run time histogram. */
+    uint64_t  elapsed_ns;                    /*!< Time since the pool was created. */
+    size_t    worker_cnt;                    /*!< Number of entries in worker_busy_ns. */
+    uint64_t *worker_busy_ns;                /*!< Time each worker spent running work. */
+} tpool_stats_t;
+
 /* - - - - */
 
 /*! Create a thread pool.
@@ -81,6 +106,31 @@ bool tpool_add_work(tpool_t *tp, thread_func_t func, void *arg);
  */
 void tpool_wait(tpool_t *tp);
 
+/* - - - - */
+
+/*! Take a snapshot of the pool's statistics.
+ *
+ * \param[in] tp Thread pool.
+ *
+ * \return Statistics. Must be destroyed with tpool_stats_destroy.
+ */
+tpool_stats_t *tpool_stats_snapshot(tpool_t *tp);
+
+/*! Destroy a statistics snapshot.
+ *
+ * \param[in,out] stats Statistics.
+ */
+void tpool_stats_destroy(tpool_stats_t *stats);
+
+/*! Fraction of the pool's lifetime a worker spent running work.
+ *
+ * \param[in] stats Statistics.
+ * \param[in] idx   Worker index. Must be less than worker_cnt.
+ *
+ * \return Value between 0 and 1.
+ */
+double tpool_stats_worker_busy(const tpool_stats_t *stats, size_t idx);
+
 /*! @}
  */
 
@@ -0,0 +1,780 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+/* syscall and MAP_POPULATE for io_uring. sync_file_range. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <sys/uio.h>
+#  if !defined(__NR_io_uring_setup)
+#    undef HAVE_LINUX_IO_URING_H
+#  endif
+#endif
+
+#include "cpthread.h"
+#include "writebehind.h"
+#include "xmem.h"
+
+/* - - - - */
+
+static const size_t wb_default_buf_size = 1024*1024;
+static const size_t wb_default_buf_cnt  = 16;
+static const size_t wb_default_writers  = 2;
+
+/* Buffers are aligned to this so they can be handed directly to the kernel. */
+#define WB_ALIGN 4096
+
+/*! A buffer. Owned by a file while being filled, then by the queue
+ * until a writer has written it, then back on the free list. */
+struct wb_buf {
+    unsigned char *data;
+    size_t         len;    /*!< Amount of data in the buffer. */
+    int64_t        offset; /*!< Offset in the file the data belongs at. */
+    wb_file_t     *wf;     /*!< File the data belongs to. */
+    struct wb_buf *next;
+    unsigned       idx;    /*!< Index of the buffer when registered with io_uring. */
+    bool           sync;   /*!< Flush the file to disk after writing. */
+};
+typedef struct wb_buf wb_buf_t;
+
+struct writebehind {
+    wb_buf_t        *free_bufs;   /*!< Buffers ready to be filled. */
+    wb_buf_t        *queue_first; /*!< Buffers waiting to be written. */
+    wb_buf_t        *queue_last;
+    wb_buf_t       **bufs;        /*!< All buffers when they're created up front for io_uring. */
+    size_t           buf_size;
+    size_t           buf_cnt;     /*!< Maximum number of buffers. */
+    size_t           buf_alloced; /*!< Buffers created so far. They're created on demand. */
+    pthread_t       *threads;
+    size_t           thread_cnt;
+    size_t           uring_cnt;   /*!< Writers using io_uring. */
+    pthread_mutex_t  mutex;
+    pthread_cond_t   free_cond;   /*!< Signaled when a buffer is returned to the free list. */
+    pthread_cond_t   queue_cond;  /*!< Signaled when a buffer is queued or when stopping. */
+    pthread_cond_t   done_cond;   /*!< Signaled when a file's pending count drops. */
+    uint32_t         flags;       /*!< wb_flags_t */
+    bool             stop;
+};
+
+struct wb_file {
+    writebehind_t *wb;
+    wb_buf_t      *cur;     /*!< Buffer being filled. */
+    int64_t        offset;  /*!< Offset the next write will go to. */
+    size_t         pending; /*!< Buffers queued but not written. Protected by the pool mutex. */
+    int            fd;
+    int            error;   /*!< errno of the first failed write. Protected by the pool mutex. */
+};
+
+/* - - - - */
+
+static wb_buf_t *wb_buf_create(size_t size, unsigned idx)
+{
+    wb_buf_t *buf;
+
+    buf      = xcalloc(1, sizeof(*buf));
+    buf->idx = idx;
+    /* Can't use xmem because it doesn't do aligned allocations. */
+    if (posix_memalign((void **)&buf->data, WB_ALIGN, size) != 0)
+        abort();
+    return buf;
+}
+
+static void wb_buf_destroy(wb_buf_t *buf)
+{
+    if (buf == NULL)
+        return;
+    free(buf->data);
+    xfree(buf);
+}
+
+/* Write part of a buffer. Returns 0 on success otherwise an errno. */
+static int wb_buf_pwrite(const wb_buf_t *buf, size_t start)
+{
+    const unsigned char *data   = buf->data + start;
+    size_t               len    = buf->len - start;
+    off_t                offset = (off_t)(buf->offset + (int64_t)start);
+    ssize_t              r;
+
+    while (len > 0) {
+        r = pwrite(buf->wf->fd, data, len, offset);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        if (r == 0)
+            return EIO;
+
+        data   += r;
+        len    -= (size_t)r;
+        offset += r;
+    }
+
+    return 0;
+}
+
+/* Push written data to disk and drop it from the page cache. Waiting
+ * for write back is required because dirty pages can't be dropped.
+ * Returns 0 on success otherwise an errno. */
+static int wb_buf_drop_cache(const wb_buf_t *buf)
+{
+    if (buf->len == 0)
+        return 0;
+
+#ifdef __linux__
+    if (sync_file_range(buf->wf->fd, (off_t)buf->offset, (off_t)buf->len,
+                SYNC_FILE_RANGE_WAIT_BEFORE|SYNC_FILE_RANGE_WRITE|SYNC_FILE_RANGE_WAIT_AFTER) != 0)
+    {
+        return errno;
+    }
+#endif
+#ifdef POSIX_FADV_DONTNEED
+    /* Only advice. Failing doesn't mean the data wasn't written. */
+    posix_fadvise(buf->wf->fd, (off_t)buf->offset, (off_t)buf->len, POSIX_FADV_DONTNEED);
+#endif
+
+    return 0;
+}
+
+/* Write an entire buffer with the plain system calls. */
+static int wb_buf_write(const wb_buf_t *buf)
+{
+    int err;
+
+    err = wb_buf_pwrite(buf, 0);
+    if (err == 0 && buf->sync && fdatasync(buf->wf->fd) != 0)
+        err = errno;
+    if (err == 0 && buf->wf->wb->flags & WB_FLAG_DROP_CACHE)
+        err = wb_buf_drop_cache(buf);
+    return err;
+}
+
+/* Mark a buffer as written and put it back on the free list.
+ * Must be called with the pool mutex locked. */
+static void wb_buf_done(writebehind_t *wb, wb_buf_t *buf, int err)
+{
+    if (err != 0 && buf->wf->error == 0)
+        buf->wf->error = err;
+    buf->wf->pending--;
+    pthread_cond_broadcast(&(wb->done_cond));
+
+    buf->next     = wb->free_bufs;
+    wb->free_bufs = buf;
+    pthread_cond_signal(&(wb->free_cond));
+}
+
+/* Pull up to max buffers off the queue. Blocks until there is at least one.
+ * Returns 0 when the pool is stopping and there's nothing left to write.
+ * Must be called with the pool mutex locked. */
+static size_t wb_queue_take(writebehind_t *wb, wb_buf_t **bufs, size_t max)
+{
+    size_t cnt = 0;
+
+    while (wb->queue_first == NULL) {
+        if (wb->stop)
+            return 0;
+        pthread_cond_wait(&(wb->queue_cond), &(wb->mutex));
+    }
+
+    while (wb->queue_first != NULL && cnt < max) {
+        bufs[cnt]       = wb->queue_first;
+        wb->queue_first = wb->queue_first->next;
+        cnt++;
+    }
+    if (wb->queue_first == NULL)
+        wb->queue_last = NULL;
+
+    return cnt;
+}
+
+/* Get a buffer to fill. Blocks until one is free if the maximum
+ * number of buffers are in use. */
+static wb_buf_t *wb_buf_get(writebehind_t *wb)
+{
+    wb_buf_t *buf = NULL;
+
+    pthread_mutex_lock(&(wb->mutex));
+    while (buf == NULL) {
+        if (wb->free_bufs != NULL) {
+            buf           = wb->free_bufs;
+            wb->free_bufs = buf->next;
+        } else if (wb->buf_alloced < wb->buf_cnt) {
+            wb->buf_alloced++;
+            /* Creating can be slow so don't hold the lock while doing it. */
+            pthread_mutex_unlock(&(wb->mutex));
+            buf = wb_buf_create(wb->buf_size, 0);
+            pthread_mutex_lock(&(wb->mutex));
+        } else {
+            pthread_cond_wait(&(wb->free_cond), &(wb->mutex));
+        }
+    }
+    pthread_mutex_unlock(&(wb->mutex));
+
+    buf->len    = 0;
+    buf->offset = 0;
+    buf->wf     = NULL;
+    buf->next   = NULL;
+    buf->sync   = false;
+    return buf;
+}
+
+/* Hand the file's current buffer to the writers. An empty buffer is
+ * only queued when it's being used to sync the file. */
+static void wb_file_queue(wb_file_t *wf)
+{
+    writebehind_t *wb  = wf->wb;
+    wb_buf_t      *buf = wf->cur;
+
+    wf->cur = NULL;
+    if (buf == NULL)
+        return;
+
+    pthread_mutex_lock(&(wb->mutex));
+    if ((buf->len == 0 && !buf->sync) || wf->error != 0) {
+        /* Nothing to write or no point writing after a failure. */
+        buf->next     = wb->free_bufs;
+        wb->free_bufs = buf;
+        pthread_cond_signal(&(wb->free_cond));
+        pthread_mutex_unlock(&(wb->mutex));
+        return;
+    }
+
+    if (wb->queue_last == NULL) {
+        wb->queue_first = buf;
+    } else {
+        wb->queue_last->next = buf;
+    }
+    wb->queue_last = buf;
+    wf->pending++;
+    pthread_cond_signal(&(wb->queue_cond));
+    pthread_mutex_unlock(&(wb->mutex));
+}
+
+static void *wb_writer(void *arg)
+{
+    writebehind_t *wb = arg;
+    wb_buf_t      *buf;
+    int            err;
+
+    pthread_mutex_lock(&(wb->mutex));
+    while (wb_queue_take(wb, &buf, 1) == 1) {
+        pthread_mutex_unlock(&(wb->mutex));
+        err = wb_buf_write(buf);
+        pthread_mutex_lock(&(wb->mutex));
+        wb_buf_done(wb, buf, err);
+    }
+    pthread_mutex_unlock(&(wb->mutex));
+
+    return NULL;
+}
+
+/* - - - - */
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+/* Number of submission queue entries per ring. Each buffer can take
+ * two (a write linked to an fsync) so this is twice the batch size. */
+#define WB_URING_ENTRIES 64
+#define WB_URING_BATCH   (WB_URING_ENTRIES/2)
+
+/* Marks completions that belong to the fsync half of a linked pair. */
+#define WB_URING_SYNC_FLAG (1ULL << 32)
+
+/* Minimal io_uring ring. liburing isn't required. */
+typedef struct {
+    int                  fd;
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void                *sq_ptr;
+    size_t               sq_len;
+    void                *cq_ptr;
+    size_t               cq_len;
+    size_t               sqes_len;
+} wb_uring_t;
+
+static int wb_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int wb_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int wb_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void wb_uring_destroy(wb_uring_t *ring)
+{
+    if (ring == NULL)
+        return;
+
+    if (ring->sqes != NULL)
+        munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr != NULL && ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sq_ptr != NULL)
+        munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    xfree(ring);
+}
+
+/* Create a ring with every pool buffer registered so writes don't need
+ * to map the buffer on each submission. Returns NULL if io_uring isn't
+ * available (old kernel, seccomp, memlock limits...). */
+static wb_uring_t *wb_uring_create(writebehind_t *wb)
+{
+    wb_uring_t             *ring;
+    struct io_uring_params  p;
+    struct iovec           *iov;
+    unsigned char          *sq;
+    unsigned char          *cq;
+    size_t                  i;
+    int                     ret;
+
+    ring     = xcalloc(1, sizeof(*ring));
+    ring->fd = -1;
+
+    memset(&p, 0, sizeof(p));
+    ring->fd = wb_uring_setup(WB_URING_ENTRIES, &p);
+    if (ring->fd < 0) {
+        wb_uring_destroy(ring);
+        return NULL;
+    }
+
+    ring->sq_len = p.sq_off.array + (p.sq_entries * sizeof(unsigned));
+    ring->cq_len = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len)
+            ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        wb_uring_destroy(ring);
+        return NULL;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            wb_uring_destroy(ring);
+            return NULL;
+        }
+    }
+
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes     = mmap(NULL, ring->sqes_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        wb_uring_destroy(ring);
+        return NULL;
+    }
+
+    sq             = ring->sq_ptr;
+    cq             = ring->cq_ptr;
+    ring->sq_head  = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    iov = xcalloc(wb->buf_cnt, sizeof(*iov));
+    for (i=0; i<wb->buf_cnt; i++) {
+        iov[i].iov_base = wb->bufs[i]->data;
+        iov[i].iov_len  = wb->buf_size;
+    }
+    ret = wb_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iov, (unsigned)wb->buf_cnt);
+    xfree(iov);
+    if (ret != 0) {
+        wb_uring_destroy(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+static void wb_uring_push(wb_uring_t *ring, unsigned *tail, const struct io_uring_sqe *sqe)
+{
+    unsigned idx;
+
+    idx                 = *tail & *ring->sq_mask;
+    ring->sqes[idx]     = *sqe;
+    ring->sq_array[idx] = idx;
+    (*tail)++;
+}
+
+/* Submit a batch of buffers and wait for all of them to complete with a
+ * single system call. Fills errs with the result for each buffer. */
+static void wb_uring_write(wb_uring_t *ring, wb_buf_t **bufs, size_t cnt, int *errs, size_t *wrote)
+{
+    struct io_uring_sqe  sqe;
+    struct io_uring_cqe *cqe;
+    unsigned             tail;
+    unsigned             head;
+    unsigned             submit = 0;
+    unsigned             done   = 0;
+    uint64_t             i;
+    int                  ret;
+
+    tail = *ring->sq_tail;
+    for (i=0; i<cnt; i++) {
+        errs[i]  = 0;
+        wrote[i] = 0;
+
+        if (bufs[i]->len > 0) {
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode    = IORING_OP_WRITE_FIXED;
+            sqe.fd        = bufs[i]->wf->fd;
+            sqe.addr      = (uint64_t)(uintptr_t)bufs[i]->data;
+            sqe.len       = (uint32_t)bufs[i]->len;
+            sqe.off       = (uint64_t)bufs[i]->offset;
+            sqe.buf_index = (uint16_t)bufs[i]->idx;
+            sqe.user_data = i;
+            /* The fsync only runs if the write fully succeeds. */
+            if (bufs[i]->sync)
+                sqe.flags = IOSQE_IO_LINK;
+            wb_uring_push(ring, &tail, &sqe);
+            submit++;
+        }
+
+        if (bufs[i]->sync) {
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode      = IORING_OP_FSYNC;
+            sqe.fd          = bufs[i]->wf->fd;
+            sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+            sqe.user_data   = i | WB_URING_SYNC_FLAG;
+            wb_uring_push(ring, &tail, &sqe);
+            submit++;
+        }
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+    while (done < submit) {
+        ret = wb_uring_enter(ring->fd, submit-done, submit-done, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR) {
+            /* The ring is broken. Anything not completed
+             * is treated as failed. */
+            for (i=0; i<cnt; i++) {
+                if (errs[i] == 0 && wrote[i] < bufs[i]->len)
+                    errs[i] = errno;
+            }
+            return;
+        }
+
+        head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &ring->cqes[head & *ring->cq_mask];
+            i   = cqe->user_data & ~WB_URING_SYNC_FLAG;
+            if (cqe->res < 0) {
+                /* A short write cancels the linked fsync. That's handled
+                 * below so don't let the cancel hide the real result. */
+                if (!(cqe->user_data & WB_URING_SYNC_FLAG) || cqe->res != -ECANCELED || wrote[i] == bufs[i]->len) {
+                    if (errs[i] == 0)
+                        errs[i] = -cqe->res;
+                }
+            } else if (!(cqe->user_data & WB_URING_SYNC_FLAG)) {
+                wrote[i] = (size_t)cqe->res;
+            }
+            head++;
+            done++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+static void *wb_uring_writer(void *arg)
+{
+    writebehind_t *wb   = arg;
+    wb_uring_t    *ring;
+    wb_buf_t      *bufs[WB_URING_BATCH];
+    int            errs[WB_URING_BATCH];
+    size_t         wrote[WB_URING_BATCH];
+    size_t         cnt;
+    size_t         i;
+
+    ring = wb_uring_create(wb);
+    if (ring == NULL)
+        return wb_writer(arg);
+
+    pthread_mutex_lock(&(wb->mutex));
+    wb->uring_cnt++;
+    while ((cnt = wb_queue_take(wb, bufs, WB_URING_BATCH)) > 0) {
+        pthread_mutex_unlock(&(wb->mutex));
+
+        wb_uring_write(ring, bufs, cnt, errs, wrote);
+        for (i=0; i<cnt; i++) {
+            /* Short writes are rare (disk full, signals). Finish
+             * them with plain writes instead of resubmitting. */
+            if (errs[i] == 0 && wrote[i] < bufs[i]->len) {
+                errs[i] = wb_buf_pwrite(bufs[i], wrote[i]);
+                if (errs[i] == 0 && bufs[i]->sync && fdatasync(bufs[i]->wf->fd) != 0)
+                    errs[i] = errno;
+            }
+            if (errs[i] == 0 && wb->flags & WB_FLAG_DROP_CACHE)
+                errs[i] = wb_buf_drop_cache(bufs[i]);
+        }
+
+        pthread_mutex_lock(&(wb->mutex));
+        for (i=0; i<cnt; i++) {
+            wb_buf_done(wb, bufs[i], errs[i]);
+        }
+    }
+    pthread_mutex_unlock(&(wb->mutex));
+
+    wb_uring_destroy(ring);
+    return NULL;
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
+
+/* - - - - */
+
+writebehind_t *wb_create(size_t buf_size, size_t buf_cnt, size_t writers, uint32_t flags)
+{
+    writebehind_t *wb;
+    void          *(*writer)(void *) = wb_writer;
+    size_t          i;
+
+    if (buf_size == 0)
+        buf_size = wb_default_buf_size;
+    if (buf_cnt == 0)
+        buf_cnt = wb_default_buf_cnt;
+    if (writers == 0)
+        writers = wb_default_writers;
+
+    wb             = xcalloc(1, sizeof(*wb));
+    wb->buf_size   = (buf_size + (WB_ALIGN-1)) & ~((size_t)WB_ALIGN-1);
+    wb->buf_cnt    = buf_cnt;
+    wb->thread_cnt = writers;
+    wb->flags      = flags;
+    wb->threads    = xcalloc(writers, sizeof(*wb->threads));
+
+    pthread_mutex_init(&(wb->mutex), NULL);
+    pthread_cond_init(&(wb->free_cond), NULL);
+    pthread_cond_init(&(wb->queue_cond), NULL);
+    pthread_cond_init(&(wb->done_cond), NULL);
+
+#ifdef HAVE_LINUX_IO_URING_H
+    if (flags & WB_FLAG_URING && buf_cnt <= UINT16_MAX) {
+        /* Registered buffers have to exist before the rings are
+         * created so they're all made up front. */
+        wb->bufs = xcalloc(buf_cnt, sizeof(*wb->bufs));
+        for (i=0; i<buf_cnt; i++) {
+            wb->bufs[i]       = wb_buf_create(wb->buf_size, (unsigned)i);
+            wb->bufs[i]->next = wb->free_bufs;
+            wb->free_bufs     = wb->bufs[i];
+        }
+        wb->buf_alloced = buf_cnt;
+        writer          = wb_uring_writer;
+    }
+#endif
+
+    for (i=0; i<writers; i++) {
+        pthread_create(&(wb->threads[i]), NULL, writer, wb);
+    }
+
+    return wb;
+}
+
+void wb_destroy(writebehind_t *wb)
+{
+    wb_buf_t *buf;
+    size_t    i;
+
+    if (wb == NULL)
+        return;
+
+    /* Writers finish anything queued before they stop. */
+    pthread_mutex_lock(&(wb->mutex));
+    wb->stop = true;
+    pthread_cond_broadcast(&(wb->queue_cond));
+    pthread_mutex_unlock(&(wb->mutex));
+
+    for (i=0; i<wb->thread_cnt; i++) {
+        pthread_join(wb->threads[i], NULL);
+    }
+
+    while (wb->free_bufs != NULL) {
+        buf           = wb->free_bufs;
+        wb->free_bufs = buf->next;
+        wb_buf_destroy(buf);
+    }
+
+    pthread_mutex_destroy(&(wb->mutex));
+    pthread_cond_destroy(&(wb->free_cond));
+    pthread_cond_destroy(&(wb->queue_cond));
+    pthread_cond_destroy(&(wb->done_cond));
+
+    xfree(wb->bufs);
+    xfree(wb->threads);
+    xfree(wb);
+}
+
+const char *wb_backend(writebehind_t *wb)
+{
+    const char *name = "pwrite";
+
+    if (wb == NULL)
+        return name;
+
+    pthread_mutex_lock(&(wb->mutex));
+    if (wb->uring_cnt > 0)
+        name = "io_uring";
+    pthread_mutex_unlock(&(wb->mutex));
+    return name;
+}
+
+/* - - - - */
+
+wb_file_t *wb_file_open(writebehind_t *wb, int fd, int64_t offset)
+{
+    wb_file_t *wf;
+
+    if (wb == NULL || fd < 0 || offset < 0)
+        return NULL;
+
+    wf         = xcalloc(1, sizeof(*wf));
+    wf->wb     = wb;
+    wf->fd     = fd;
+    wf->offset = offset;
+    return wf;
+}
+
+bool wb_file_write(wb_file_t *wf, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t               n;
+    int                  err;
+
+    if (wf == NULL)
+        return false;
+
+    /* Stop accepting data once a write has failed so the
+     * producer can give up early. */
+    pthread_mutex_lock(&(wf->wb->mutex));
+    err = wf->error;
+    pthread_mutex_unlock(&(wf->wb->mutex));
+    if (err != 0)
+        return false;
+
+    while (len > 0) {
+        if (wf->cur == NULL) {
+            wf->cur         = wb_buf_get(wf->wb);
+            wf->cur->wf     = wf;
+            wf->cur->offset = wf->offset;
+        }
+
+        n = wf->wb->buf_size - wf->cur->len;
+        if (n > len)
+            n = len;
+
+        memcpy(wf->cur->data+wf->cur->len, p, n);
+        wf->cur->len += n;
+        wf->offset   += (int64_t)n;
+        p            += n;
+        len          -= n;
+
+        if (wf->cur->len == wf->wb->buf_size)
+            wb_file_queue(wf);
+    }
+
+    return true;
+}
+
+int64_t wb_file_offset(const wb_file_t *wf)
+{
+    if (wf == NULL)
+        return 0;
+    return wf->offset;
+}
+
+bool wb_file_close(wb_file_t *wf, bool sync)
+{
+    writebehind_t *wb;
+    wb_buf_t      *last;
+    int            err;
+
+    if (wf == NULL)
+        return false;
+
+    wb   = wf->wb;
+    last = wf->cur;
+    if (sync) {
+        /* The sync is attached to the last buffer. It can only cover what's
+         * already been written so wait for everything else first. */
+        wf->cur = NULL;
+        pthread_mutex_lock(&(wb->mutex));
+        while (wf->pending > 0)
+            pthread_cond_wait(&(wb->done_cond), &(wb->mutex));
+        pthread_mutex_unlock(&(wb->mutex));
+
+        if (last == NULL) {
+            last         = wb_buf_get(wb);
+            last->wf     = wf;
+            last->offset = wf->offset;
+        }
+        last->sync = true;
+        wf->cur    = last;
+    }
+    wb_file_queue(wf);
+
+    pthread_mutex_lock(&(wb->mutex));
+    while (wf->pending > 0)
+        pthread_cond_wait(&(wb->done_cond), &(wb->mutex));
+    err = wf->error;
+    pthread_mutex_unlock(&(wb->mutex));
+
+    xfree(wf);
+    return err == 0;
+}
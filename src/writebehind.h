@@ -0,0 +1,142 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __WRITEBEHIND_H__
+#define __WRITEBEHIND_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*! \addtogroup writebehind Write Behind
+ *
+ * Decouples producing data from writing it to disk. Data is copied into
+ * large aligned buffers which are written out by dedicated writer threads.
+ * The number of buffers is bounded. When all of them are waiting to be
+ * written, writing blocks until one is free. That applies backpressure to
+ * the producer instead of letting memory grow without bound.
+ *
+ * Buffers are written with positional writes so buffers belonging to the
+ * same file can be written in any order by any writer.
+ *
+ * On Linux the writers can use io_uring instead of individual system
+ * calls. Each writer submits every buffer waiting in the queue at once
+ * and waits for them all with a single call. Buffers are registered with
+ * the kernel up front so they don't have to be mapped on each write. If
+ * io_uring isn't available the writers fall back to positional writes.
+ *
+ * Data written through the pool can optionally be dropped from the page
+ * cache once it's on disk. Files that are written once and not read back
+ * then don't push other data out of memory no matter how large they are.
+ *
+ * @{
+ */
+
+struct writebehind;
+typedef struct writebehind writebehind_t;
+
+struct wb_file;
+typedef struct wb_file wb_file_t;
+
+/*! Options for a pool. */
+typedef enum {
+    WB_FLAG_NONE       = 0,
+    WB_FLAG_URING      = 1 << 0, /*!< Write using io_uring when available. All
+                                      buffers are allocated immediately. */
+    WB_FLAG_DROP_CACHE = 1 << 1  /*!< Flush each buffer once written and drop
+                                      it from the page cache. */
+} wb_flags_t;
+
+/* - - - - */
+
+/*! Create a write behind pool.
+ *
+ * \param[in] buf_size Size of each buffer. If 0 defaults to 1 MiB.
+ * \param[in] buf_cnt  Maximum number of buffers. If 0 defaults to 16.
+ * \param[in] writers  Number of writer threads. If 0 defaults to 2.
+ * \param[in] flags    wb_flags_t options.
+ *
+ * \return Pool.
+ */
+writebehind_t *wb_create(size_t buf_size, size_t buf_cnt, size_t writers, uint32_t flags);
+
+/*! Destroy a write behind pool.
+ *
+ * All files must be closed first.
+ *
+ * \param[in,out] wb Pool.
+ */
+void wb_destroy(writebehind_t *wb);
+
+/*! Name of the method used to write data.
+ *
+ * \param[in] wb Pool.
+ *
+ * \return "io_uring" if any writer is using io_uring, otherwise "pwrite".
+ */
+const char *wb_backend(writebehind_t *wb);
+
+/* - - - - */
+
+/*! Start writing to a file.
+ *
+ * \param[in,out] wb     Pool.
+ * \param[in]     fd     Open file descriptor. Not closed by the pool.
+ * \param[in]     offset Offset in the file to start writing at.
+ *
+ * \return File.
+ */
+wb_file_t *wb_file_open(writebehind_t *wb, int fd, int64_t offset);
+
+/*! Queue data to be written.
+ *
+ * \param[in,out] wf   File.
+ * \param[in]     data Data.
+ * \param[in]     len  Length of data.
+ *
+ * \return true if the data was queued. false if an earlier write
+ *         to the file failed.
+ */
+bool wb_file_write(wb_file_t *wf, const void *data, size_t len);
+
+/*! Offset the next write will be placed at.
+ *
+ * \param[in] wf File.
+ *
+ * \return Offset.
+ */
+int64_t wb_file_offset(const wb_file_t *wf);
+
+/*! Write any remaining data and wait for all of it to be written.
+ *
+ * \param[in,out] wf   File. Destroyed by this call.
+ * \param[in]     sync Flush the file's data to disk once written.
+ *
+ * \return true if all data was written, otherwise false.
+ */
+bool wb_file_close(wb_file_t *wf, bool sync);
+
+/*! @}
+ */
+
+#endif /* __WRITEBEHIND_H__ */
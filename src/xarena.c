@@ -0,0 +1,193 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpthread.h"
+#include "xarena.h"
+#include "xmem.h"
+
+/* - - - - */
+
+static const size_t xarena_default_block_size = 4096;
+
+/* All allocations are aligned to this. Enough for any basic type. */
+#define XARENA_ALIGN 16
+
+/*! A block of memory allocations are carved from. The usable
+ * memory follows the header. */
+struct xarena_block {
+    struct xarena_block *next; /*!< Previous block that was filled. */
+    size_t               size; /*!< Usable size of the block. */
+    size_t               used; /*!< Bytes handed out from the block. */
+};
+typedef struct xarena_block xarena_block_t;
+
+struct xarena {
+    xarena_block_t  *blocks;     /*!< Block currently being allocated from. Older blocks follow. */
+    size_t           block_size; /*!< Default usable size of new blocks. */
+    volatile size_t  refcnt;     /*!< References held on the arena. */
+};
+
+/* - - - - */
+
+static size_t xarena_align(size_t size)
+{
+    return (size + (XARENA_ALIGN-1)) & ~((size_t)XARENA_ALIGN-1);
+}
+
+/* The header is padded so the first allocation is aligned. */
+static size_t xarena_block_header_size(void)
+{
+    return xarena_align(sizeof(xarena_block_t));
+}
+
+static unsigned char *xarena_block_data(xarena_block_t *block)
+{
+    return (unsigned char *)block + xarena_block_header_size();
+}
+
+static xarena_block_t *xarena_block_create(size_t size)
+{
+    xarena_block_t *block;
+
+    block       = xmalloc(xarena_block_header_size() + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+/* - - - - */
+
+xarena_t *xarena_create(size_t block_size)
+{
+    xarena_t *arena;
+
+    if (block_size == 0)
+        block_size = xarena_default_block_size;
+
+    arena             = xcalloc(1, sizeof(*arena));
+    arena->block_size = xarena_align(block_size);
+    arena->refcnt     = 1;
+
+    return arena;
+}
+
+void xarena_retain(xarena_t *arena)
+{
+    if (arena == NULL)
+        return;
+
+    cpthread_atomic_inc(&(arena->refcnt));
+}
+
+void xarena_release(xarena_t *arena)
+{
+    xarena_block_t *block;
+    xarena_block_t *next;
+
+    if (arena == NULL)
+        return;
+
+    if (cpthread_atomic_dec(&(arena->refcnt)) > 0)
+        return;
+
+    block = arena->blocks;
+    while (block != NULL) {
+        next = block->next;
+        xfree(block);
+        block = next;
+    }
+
+    xfree(arena);
+}
+
+/* - - - - */
+
+void *xarena_alloc(xarena_t *arena, size_t size)
+{
+    xarena_block_t *block;
+    void           *p;
+
+    if (arena == NULL || size == 0)
+        abort();
+
+    size  = xarena_align(size);
+    block = arena->blocks;
+
+    if (block == NULL || block->size - block->used < size) {
+        if (size > arena->block_size / 4) {
+            /* Large allocations get their own block so the remaining space
+             * in the current block isn't wasted. It's put behind the
+             * current block so allocation continues from the current one. */
+            block = xarena_block_create(size);
+            if (arena->blocks == NULL) {
+                arena->blocks = block;
+            } else {
+                block->next         = arena->blocks->next;
+                arena->blocks->next = block;
+            }
+        } else {
+            block         = xarena_block_create(arena->block_size);
+            block->next   = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+
+    p            = xarena_block_data(block) + block->used;
+    block->used += size;
+    return p;
+}
+
+void *xarena_calloc(xarena_t *arena, size_t count, size_t size)
+{
+    void *p;
+
+    if (count == 0 || size == 0 || count > SIZE_MAX / size)
+        abort();
+
+    p = xarena_alloc(arena, count*size);
+    memset(p, 0, count*size);
+    return p;
+}
+
+char *xarena_strdup(xarena_t *arena, const char *s)
+{
+    if (s == NULL)
+        s = "";
+    return xarena_strndup(arena, s, strlen(s));
+}
+
+char *xarena_strndup(xarena_t *arena, const char *s, size_t len)
+{
+    char *out;
+
+    out = xarena_alloc(arena, len+1);
+    if (len > 0)
+        memcpy(out, s, len);
+    out[len] = '\0';
+    return out;
+}
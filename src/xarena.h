@@ -0,0 +1,114 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#ifndef __XARENA_H__
+#define __XARENA_H__
+
+#include <stddef.h>
+
+/*! \addtogroup xarena Arena Allocator
+ *
+ * Region allocator for objects that share a lifetime. Memory is handed out
+ * from large blocks and is only released when the arena is destroyed.
+ *
+ * Allocating from an arena is not thread safe. Retaining and releasing
+ * the arena is thread safe so objects allocated from it can be handed off
+ * to other threads as long as each holds a reference.
+ *
+ * @{
+ */
+
+struct xarena;
+typedef struct xarena xarena_t;
+
+/* - - - - */
+
+/*! Create an arena.
+ *
+ * The arena starts with a reference count of 1.
+ *
+ * \param[in] block_size Size of each block. If 0 a default is used.
+ *
+ * \return Arena.
+ */
+xarena_t *xarena_create(size_t block_size);
+
+/*! Add a reference to the arena.
+ *
+ * \param[in,out] arena Arena.
+ */
+void xarena_retain(xarena_t *arena);
+
+/*! Remove a reference from the arena.
+ *
+ * All memory allocated from the arena is freed when the
+ * last reference is released.
+ *
+ * \param[in,out] arena Arena.
+ */
+void xarena_release(xarena_t *arena);
+
+/* - - - - */
+
+/*! Allocate memory from the arena.
+ *
+ * \param[in,out] arena Arena.
+ * \param[in]     size  Number of bytes.
+ *
+ * \return Memory. Aborts on failure.
+ */
+void *xarena_alloc(xarena_t *arena, size_t size);
+
+/*! Allocate zeroed memory from the arena.
+ *
+ * \param[in,out] arena Arena.
+ * \param[in]     count Number of elements.
+ * \param[in]     size  Size of each element.
+ *
+ * \return Memory. Aborts on failure.
+ */
+void *xarena_calloc(xarena_t *arena, size_t count, size_t size);
+
+/*! Copy a string into the arena.
+ *
+ * \param[in,out] arena Arena.
+ * \param[in]     s     String. NULL is treated as "".
+ *
+ * \return Copy of the string.
+ */
+char *xarena_strdup(xarena_t *arena, const char *s);
+
+/*! Copy part of a string into the arena.
+ *
+ * \param[in,out] arena Arena.
+ * \param[in]     s     String.
+ * \param[in]     len   Number of characters to copy.
+ *
+ * \return NULL terminated copy of the string.
+ */
+char *xarena_strndup(xarena_t *arena, const char *s, size_t len);
+
+/*! @}
+ */
+
+#endif /* __XARENA_H__ */
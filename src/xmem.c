@@ -22,53 +22,275 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef XMEM_USE_MIMALLOC
+#  include <mimalloc.h>
+#endif
+
+#ifdef XMEM_STATS
+#  include "cpthread.h"
+#endif
 
 #include "xmem.h"
 
 /* - - - - */
 
-void *xcalloc(size_t count, size_t size)
+#if defined(XMEM_USE_MIMALLOC)
+static xmem_allocator_t xmem_allocator = { mi_malloc, mi_calloc, mi_realloc, mi_free };
+static const char *xmem_name           = "mimalloc";
+#else
+static xmem_allocator_t xmem_allocator = { malloc, calloc, realloc, free };
+#  if defined(XMEM_USE_JEMALLOC)
+/* jemalloc replaces the system malloc when linked in. */
+static const char *xmem_name           = "jemalloc";
+#  else
+static const char *xmem_name           = "system";
+#  endif
+#endif
+
+/* Once something has been allocated the allocator can't be changed. */
+static bool xmem_used = false;
+
+/* - - - - */
+
+#ifdef XMEM_STATS
+
+/* Every allocation is prefixed with a header recording its size and call
+ * site so frees can be attributed. The header is 16 bytes to keep the
+ * returned memory aligned the same as the allocator's. */
+typedef union {
+    struct {
+        size_t size;
+        size_t tag;
+    } h;
+    unsigned char pad[16];
+} xmem_hdr_t;
+
+static pthread_mutex_t xmem_mutex = PTHREAD_MUTEX_INITIALIZER;
+static xmem_stats_t    xmem_stats = { 0 };
+
+/* Hash table of call sites. Index 0 is reserved for
+ * call sites that didn't fit in the table. */
+static size_t xmem_tag_idx(const char *tag)
+{
+    size_t      idx;
+    size_t      i;
+    uint64_t    hash = 14695981039346656037ULL;
+    const char *p;
+
+    for (p=tag; *p!='\0'; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 1099511628211ULL;
+    }
+
+    for (i=0; i<XMEM_TAGS_MAX-1; i++) {
+        idx = 1 + ((hash + i) % (XMEM_TAGS_MAX-1));
+        if (xmem_stats.tags[idx].tag == NULL) {
+            xmem_stats.tags[idx].tag = tag;
+            xmem_stats.tag_cnt++;
+            return idx;
+        }
+        if (xmem_stats.tags[idx].tag == tag || strcmp(xmem_stats.tags[idx].tag, tag) == 0)
+            return idx;
+    }
+    return 0;
+}
+
+/* Must be called with xmem_mutex locked. */
+static void xmem_stats_add(xmem_hdr_t *hdr, size_t size, const char *tag)
+{
+    xmem_tag_stats_t *ts;
+
+    hdr->h.size = size;
+    hdr->h.tag  = xmem_tag_idx(tag);
+    ts          = &xmem_stats.tags[hdr->h.tag];
+
+    ts->allocs++;
+    ts->live += size;
+    if (ts->live > ts->peak)
+        ts->peak = ts->live;
+
+    xmem_stats.live += size;
+    if (xmem_stats.live > xmem_stats.peak)
+        xmem_stats.peak = xmem_stats.live;
+}
+
+/* Must be called with xmem_mutex locked. */
+static void xmem_stats_remove(const xmem_hdr_t *hdr)
+{
+    xmem_stats.tags[hdr->h.tag].live -= hdr->h.size;
+    xmem_stats.live                  -= hdr->h.size;
+}
+
+static void *xmem_stats_alloc(void *p, size_t size, const char *tag)
+{
+    if (p == NULL)
+        abort();
+
+    pthread_mutex_lock(&xmem_mutex);
+    if (xmem_stats.tags[0].tag == NULL)
+        xmem_stats.tags[0].tag = "other";
+    xmem_stats.allocs++;
+    xmem_stats_add(p, size, tag);
+    pthread_mutex_unlock(&xmem_mutex);
+
+    return (unsigned char *)p + sizeof(xmem_hdr_t);
+}
+
+#endif /* XMEM_STATS */
+
+/* - - - - */
+
+void *xmem_calloc(size_t count, size_t size, const char *tag)
 {
     void *p;
 
     if (count == 0 || size == 0)
         abort();
+    xmem_used = true;
 
-    p = calloc(count, size);
+#ifdef XMEM_STATS
+    if (count > (SIZE_MAX - sizeof(xmem_hdr_t)) / size)
+        abort();
+    p = xmem_allocator.calloc_fn(1, sizeof(xmem_hdr_t) + (count * size));
+    return xmem_stats_alloc(p, count * size, tag);
+#else
+    (void)tag;
+    p = xmem_allocator.calloc_fn(count, size);
     if (p == NULL)
         abort();
     return p;
+#endif
 }
 
-void *xmalloc(size_t size)
+void *xmem_malloc(size_t size, const char *tag)
 {
     void *p;
 
     if (size == 0)
         abort();
+    xmem_used = true;
 
-    p = malloc(size);
+#ifdef XMEM_STATS
+    if (size > SIZE_MAX - sizeof(xmem_hdr_t))
+        abort();
+    p = xmem_allocator.malloc_fn(sizeof(xmem_hdr_t) + size);
+    return xmem_stats_alloc(p, size, tag);
+#else
+    (void)tag;
+    p = xmem_allocator.malloc_fn(size);
     if (p == NULL)
         abort();
     return p;
+#endif
 }
 
-void xfree(void *ptr)
+char *xmem_strdup(const char *s, const char *tag)
+{
+    char   *out;
+    size_t  len;
+
+    if (s == NULL)
+        abort();
+
+    len = strlen(s);
+    out = xmem_malloc(len+1, tag);
+    memcpy(out, s, len+1);
+    return out;
+}
+
+void xmem_free(void *ptr)
 {
     if (ptr == NULL)
         return;
-    free(ptr);
+
+#ifdef XMEM_STATS
+    ptr = (unsigned char *)ptr - sizeof(xmem_hdr_t);
+    pthread_mutex_lock(&xmem_mutex);
+    xmem_stats.frees++;
+    xmem_stats_remove(ptr);
+    pthread_mutex_unlock(&xmem_mutex);
+#endif
+
+    xmem_allocator.free_fn(ptr);
 }
 
-void *xrealloc(void *ptr, size_t size)
+void *xmem_realloc(void *ptr, size_t size, const char *tag)
 {
     void *p;
 
     if (ptr == NULL || size == 0)
         abort();
 
-    p = realloc(ptr, size);
+#ifdef XMEM_STATS
+    if (size > SIZE_MAX - sizeof(xmem_hdr_t))
+        abort();
+
+    ptr = (unsigned char *)ptr - sizeof(xmem_hdr_t);
+    /* Take the memory out of the stats before reallocating because
+     * ptr may be freed. The original tag is kept so the memory stays
+     * attributed to the call site that created it. */
+    pthread_mutex_lock(&xmem_mutex);
+    xmem_stats_remove(ptr);
+    tag = xmem_stats.tags[((xmem_hdr_t *)ptr)->h.tag].tag;
+    pthread_mutex_unlock(&xmem_mutex);
+
+    p = xmem_allocator.realloc_fn(ptr, sizeof(xmem_hdr_t) + size);
+    if (p == NULL)
+        abort();
+
+    pthread_mutex_lock(&xmem_mutex);
+    xmem_stats.reallocs++;
+    xmem_stats_add(p, size, tag);
+    pthread_mutex_unlock(&xmem_mutex);
+
+    return (unsigned char *)p + sizeof(xmem_hdr_t);
+#else
+    (void)tag;
+    p = xmem_allocator.realloc_fn(ptr, size);
     if (p == NULL)
         abort();
     return p;
+#endif
+}
+
+/* - - - - */
+
+bool xmem_set_allocator(const xmem_allocator_t *allocator)
+{
+    if (xmem_used || allocator == NULL)
+        return false;
+
+    if (allocator->malloc_fn == NULL || allocator->calloc_fn == NULL ||
+        allocator->realloc_fn == NULL || allocator->free_fn == NULL)
+    {
+        return false;
+    }
+
+    xmem_allocator = *allocator;
+    return true;
+}
+
+const char *xmem_allocator_name(void)
+{
+    return xmem_name;
+}
+
+xmem_stats_t *xmem_stats_snapshot(void)
+{
+#ifdef XMEM_STATS
+    xmem_stats_t *stats;
+
+    /* Allocate before locking because allocating takes the lock. */
+    stats = xmalloc(sizeof(*stats));
+
+    pthread_mutex_lock(&xmem_mutex);
+    memcpy(stats, &xmem_stats, sizeof(*stats));
+    pthread_mutex_unlock(&xmem_mutex);
+
+    return stats;
+#else
+    return NULL;
+#endif
 }
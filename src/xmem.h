@@ -24,13 +24,105 @@
 #ifndef __XMEM_H__
 #define __XMEM_H__
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/*! \addtogroup xmem Memory
+ *
+ * Allocation wrappers that abort on failure.
+ *
+ * Every allocation is tagged with the call site that made it. When built
+ * with XMEM_STATS the tags are used to count allocations and live bytes per
+ * call site. Otherwise the tags are ignored.
+ *
+ * Memory allocated with these functions must be freed with xfree and memory
+ * not allocated with these functions must never be passed to xfree.
+ *
+ * @{
+ */
+
+/* - - - - */
+
+#define XMEM_STR2(x) #x
+#define XMEM_STR(x)  XMEM_STR2(x)
+#define XMEM_TAG     __FILE__ ":" XMEM_STR(__LINE__)
+
+#define xcalloc(count, size)  xmem_calloc((count), (size), XMEM_TAG)
+#define xmalloc(size)         xmem_malloc((size), XMEM_TAG)
+#define xrealloc(ptr, size)   xmem_realloc((ptr), (size), XMEM_TAG)
+#define xstrdup(s)            xmem_strdup((s), XMEM_TAG)
+#define xfree(ptr)            xmem_free((ptr))
+
+/* - - - - */
+
+/*! Functions used to allocate memory.
+ *
+ * The default is the system allocator unless another was chosen
+ * at build time.
+ */
+typedef struct {
+    void *(*malloc_fn)(size_t size);
+    void *(*calloc_fn)(size_t count, size_t size);
+    void *(*realloc_fn)(void *ptr, size_t size);
+    void  (*free_fn)(void *ptr);
+} xmem_allocator_t;
+
+/*! Number of call sites statistics can be tracked for.
+ * Once full, additional call sites are counted under "other". */
+#define XMEM_TAGS_MAX 256
+
+/*! Statistics for a call site. */
+typedef struct {
+    const char *tag;    /*!< File and line. */
+    uint64_t    allocs; /*!< Number of allocations. */
+    size_t      live;   /*!< Bytes currently allocated. */
+    size_t      peak;   /*!< Most bytes allocated at one time. */
+} xmem_tag_stats_t;
+
+/*! Snapshot of allocation statistics. */
+typedef struct {
+    size_t           live;                /*!< Bytes currently allocated. */
+    size_t           peak;                /*!< Most bytes allocated at one time. */
+    uint64_t         allocs;              /*!< Number of allocations. */
+    uint64_t         reallocs;            /*!< Number of reallocations. */
+    uint64_t         frees;               /*!< Number of frees. */
+    size_t           tag_cnt;             /*!< Number of call sites seen. */
+    xmem_tag_stats_t tags[XMEM_TAGS_MAX]; /*!< Per call site statistics. Unused entries have a NULL tag. */
+} xmem_stats_t;
+
+/* - - - - */
+
+void *xmem_calloc(size_t count, size_t size, const char *tag);
+void *xmem_malloc(size_t size, const char *tag);
+void *xmem_realloc(void *ptr, size_t size, const char *tag);
+char *xmem_strdup(const char *s, const char *tag);
+void xmem_free(void *ptr);
 
 /* - - - - */
 
-void *xcalloc(size_t count, size_t size);
-void *xmalloc(size_t size);
-void *xrealloc(void *ptr, size_t size);
-void xfree(void *ptr);
+/*! Route all allocations through a different allocator.
+ *
+ * Must be called before anything is allocated.
+ *
+ * \param[in] allocator Allocator functions. All must be set.
+ *
+ * \return true if the allocator was set. false if memory has
+ *         already been allocated or allocator is invalid.
+ */
+bool xmem_set_allocator(const xmem_allocator_t *allocator);
+
+/*! Name of the allocator chosen at build time. */
+const char *xmem_allocator_name(void);
+
+/*! Take a snapshot of allocation statistics.
+ *
+ * \return Statistics. NULL if not built with XMEM_STATS. Must
+ *         be freed with xfree.
+ */
+xmem_stats_t *xmem_stats_snapshot(void);
+
+/*! @}
+ */
 
 #endif /* __XMEM_H__ */
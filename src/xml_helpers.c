@@ -21,9 +21,11 @@
  * THE SOFTWARE
  */
 
+#include <limits.h>
 #include <string.h>
 
 #include "str_helpers.h"
+#include "xmem.h"
 #include "xml_helpers.h"
 
 /* XPath parsing helper. Takes all nodes matching an xpath and runs them
@@ -76,13 +78,92 @@ void parse_nodes_int(const char *xml, const char *xpath, node_processor_cb_t np,
     xmlFreeDoc(doc);
 }
 
-/* Get the text from the first node matching the XPath. This should only be
- * used when there is known to be only one node. If there are multiple nodes
- * either because it's a repeating tag or because the XPath encompasses
- * matching multiple tags, then use parse_nodes_int. */
-char *get_xml_text(const char *xpath, xmlDocPtr doc, xmlNodePtr node)
+/* Walk elements from a reader. Matching elements are expanded into a
+ * subtree then skipped over so the reader can free them once processed.
+ * Only one element (and its children) is ever held in memory at a time. */
+static bool parse_stream_nodes_reader(xmlTextReaderPtr reader, const char *name, node_processor_cb_t np, void *arg)
+{
+    const xmlChar *lname;
+    xmlNodePtr     cur;
+    int            ret;
+
+    ret = xmlTextReaderRead(reader);
+    while (ret == 1) {
+        lname = xmlTextReaderConstLocalName(reader);
+        if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT || lname == NULL || strcmp((const char *)lname, name) != 0) {
+            ret = xmlTextReaderRead(reader);
+            continue;
+        }
+
+        cur = xmlTextReaderExpand(reader);
+        if (cur == NULL) {
+            ret = -1;
+            break;
+        }
+
+        /* Don't use xmlTextReaderCurrentDoc because it tells the reader
+         * to preserve the document which prevents it from freeing nodes
+         * as it goes. */
+        if (!np(cur->doc, cur, arg))
+            break;
+
+        ret = xmlTextReaderNext(reader);
+    }
+
+    return ret != -1;
+}
+
+bool parse_stream_nodes_mem(const char *xml, size_t len, const char *name, node_processor_cb_t np, void *arg)
+{
+    xmlTextReaderPtr reader;
+    bool             ret;
+
+    if (xml == NULL || len == 0 || len > INT_MAX || str_isempty(name) || np == NULL)
+        return false;
+
+    reader = xmlReaderForMemory(xml, (int)len, NULL, NULL, XML_PARSE_NONET|XML_PARSE_COMPACT);
+    if (reader == NULL)
+        return false;
+
+    ret = parse_stream_nodes_reader(reader, name, np, arg);
+    xmlFreeTextReader(reader);
+    return ret;
+}
+
+/* Get the content of the first child element of node with the given name. */
+static xmlChar *get_xml_child_content(xmlNodePtr node, const char *name)
+{
+    xmlNodePtr cur;
+
+    if (node == NULL || str_isempty(name))
+        return NULL;
+
+    for (cur=node->children; cur!=NULL; cur=cur->next) {
+        if (cur->type != XML_ELEMENT_NODE || strcmp((const char *)cur->name, name) != 0)
+            continue;
+        return xmlNodeGetContent(cur);
+    }
+
+    return NULL;
+}
+
+char *get_xml_child_text(xmlNodePtr node, const char *name)
+{
+    xmlChar *xtext;
+    char    *text;
+
+    xtext = get_xml_child_content(node, name);
+    if (xtext == NULL)
+        return NULL;
+
+    text = xstrdup((const char *)xtext);
+    xmlFree(xtext);
+    return text;
+}
+
+/* Get the content of the first node matching the XPath. */
+static xmlChar *get_xml_content(const char *xpath, xmlDocPtr doc, xmlNodePtr node)
 {
-    char               *text;
     xmlChar            *xtext;
     xmlXPathContextPtr  xctx;
     xmlXPathObjectPtr   xobj;
@@ -119,10 +200,26 @@ char *get_xml_text(const char *xpath, xmlDocPtr doc, xmlNodePtr node)
 
     cur   = xobj->nodesetval->nodeTab[0];
     xtext = xmlNodeGetContent(cur);
-    text  = strdup((const char *)xtext);
-    xmlFree(xtext);
 
     xmlXPathFreeObject(xobj);
     xmlXPathFreeContext(xctx);
+    return xtext;
+}
+
+/* Get the text from the first node matching the XPath. This should only be
+ * used when there is known to be only one node. If there are multiple nodes
+ * either because it's a repeating tag or because the XPath encompasses
+ * matching multiple tags, then use parse_nodes_int. */
+char *get_xml_text(const char *xpath, xmlDocPtr doc, xmlNodePtr node)
+{
+    char    *text;
+    xmlChar *xtext;
+
+    xtext = get_xml_content(xpath, doc, node);
+    if (xtext == NULL)
+        return NULL;
+
+    text = xstrdup((const char *)xtext);
+    xmlFree(xtext);
     return text;
 }
@@ -30,6 +30,7 @@
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/xmlreader.h>
 
 /* - - - - */
 
@@ -40,4 +41,12 @@ typedef bool (*node_processor_cb_t)(xmlDocPtr doc, xmlNodePtr node, void *arg);
 void parse_nodes_int(const char *xml, const char *xpath, node_processor_cb_t np, void *arg);
 char *get_xml_text(const char *xpath, xmlDocPtr doc, xmlNodePtr node);
 
+/* Stream parse a buffer and run every element named name (at any depth)
+ * through np. The node and its subtree are only valid during the callback.
+ * Returns false if the XML is malformed. Nodes up to the error will have
+ * already been processed. */
+bool parse_stream_nodes_mem(const char *xml, size_t len, const char *name, node_processor_cb_t np, void *arg);
+/* Get the text of the first child element of node with the given name. */
+char *get_xml_child_text(xmlNodePtr node, const char *name);
+
 #endif /* __XML_HELPERS_H__ */
@@ -0,0 +1,166 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ep_store.h"
+#include "rw_files.h"
+#include "test.h"
+
+/* - - - - */
+
+#define STORE_FILE "test_ep_store.db"
+
+/* Enough to grow the store from its minimum size more than once. */
+#define MANY 3000
+
+static ep_store_key_t key_n(size_t n)
+{
+    char id[32];
+
+    snprintf(id, sizeof(id), "guid-%zu", n);
+    return ep_store_key("cast", id);
+}
+
+/* - - - - */
+
+static void test_states(void)
+{
+    ep_store_t     *st;
+    ep_store_key_t  key;
+    int64_t         offset;
+    time_t          pubdate;
+    uint32_t        failures;
+
+    rw_file_unlink(STORE_FILE);
+    st  = ep_store_open(STORE_FILE);
+    CHECK(st != NULL);
+    key = ep_store_key("cast", "guid");
+
+    CHECK(ep_store_get(st, key, &offset, &pubdate, &failures) == EP_STATE_NONE);
+    CHECK(ep_store_get(NULL, key, NULL, NULL, NULL) == EP_STATE_NONE);
+
+    /* Only known episodes get a publish date. */
+    ep_store_set_pubdate(st, key, 1000);
+    CHECK(ep_store_get(st, key, NULL, NULL, NULL) == EP_STATE_NONE);
+
+    ep_store_set(st, key, EP_STATE_SEEN, 0);
+    ep_store_set_pubdate(st, key, 1000);
+    CHECK(ep_store_get(st, key, &offset, &pubdate, &failures) == EP_STATE_SEEN);
+    CHECK(pubdate == 1000);
+    CHECK(failures == 0);
+
+    ep_store_set(st, key, EP_STATE_FAILED, 0);
+    ep_store_set(st, key, EP_STATE_FAILED, 0);
+    CHECK(ep_store_get(st, key, &offset, &pubdate, &failures) == EP_STATE_FAILED);
+    CHECK(failures == 2);
+    CHECK(pubdate == 1000);
+
+    ep_store_set(st, key, EP_STATE_PARTIAL, 1234);
+    CHECK(ep_store_get(st, key, &offset, NULL, &failures) == EP_STATE_PARTIAL);
+    CHECK(offset == 1234);
+    CHECK(failures == 3);
+
+    ep_store_set(st, key, EP_STATE_DOWNLOADED, 1234);
+    CHECK(ep_store_get(st, key, &offset, NULL, &failures) == EP_STATE_DOWNLOADED);
+    CHECK(offset == 0);
+    CHECK(failures == 0);
+
+    /* Keys depend on both the cast and the id. */
+    CHECK(ep_store_get(st, ep_store_key("cast2", "guid"), NULL, NULL, NULL) == EP_STATE_NONE);
+    CHECK(ep_store_get(st, ep_store_key("cas", "tguid"), NULL, NULL, NULL) == EP_STATE_NONE);
+
+    ep_store_close(st);
+    rw_file_unlink(STORE_FILE);
+}
+
+static void test_grow_reopen(void)
+{
+    ep_store_t *st;
+    int64_t     size;
+    int64_t     offset;
+    time_t      pubdate;
+    uint32_t    failures;
+    size_t      i;
+    bool        ok;
+
+    rw_file_unlink(STORE_FILE);
+    st   = ep_store_open(STORE_FILE);
+    size = rw_file_size(STORE_FILE);
+    CHECK(size > 0);
+
+    for (i=0; i<MANY; i++) {
+        ep_store_set(st, key_n(i), i%2==0?EP_STATE_DOWNLOADED:EP_STATE_PARTIAL, (int64_t)i);
+        ep_store_set_pubdate(st, key_n(i), (time_t)(i+1));
+    }
+    CHECK(rw_file_size(STORE_FILE) > size);
+    ep_store_close(st);
+
+    st = ep_store_open(STORE_FILE);
+    CHECK(st != NULL);
+    ok = true;
+    for (i=0; i<MANY; i++) {
+        if (i%2 == 0) {
+            ok = ok && ep_store_get(st, key_n(i), &offset, &pubdate, &failures) == EP_STATE_DOWNLOADED;
+            ok = ok && offset == 0 && failures == 0;
+        } else {
+            ok = ok && ep_store_get(st, key_n(i), &offset, &pubdate, &failures) == EP_STATE_PARTIAL;
+            ok = ok && offset == (int64_t)i && failures == 1;
+        }
+        ok = ok && pubdate == (time_t)(i+1);
+    }
+    CHECK(ok);
+    CHECK(ep_store_get(st, key_n(MANY), NULL, NULL, NULL) == EP_STATE_NONE);
+    ep_store_close(st);
+
+    /* No temporary file is left behind from growing. */
+    CHECK(!rw_file_exists(STORE_FILE ".tmp"));
+    rw_file_unlink(STORE_FILE);
+}
+
+static void test_invalid(void)
+{
+    ep_store_t *st;
+
+    rw_write_file(STORE_FILE, (const unsigned char *)"not a store", 11, false);
+    st = ep_store_open(STORE_FILE);
+    CHECK(st != NULL);
+    CHECK(ep_store_get(st, key_n(0), NULL, NULL, NULL) == EP_STATE_NONE);
+    ep_store_set(st, key_n(0), EP_STATE_SEEN, 0);
+    CHECK(ep_store_get(st, key_n(0), NULL, NULL, NULL) == EP_STATE_SEEN);
+    ep_store_close(st);
+    rw_file_unlink(STORE_FILE);
+
+    CHECK(ep_store_open(NULL) == NULL);
+    CHECK(ep_store_open("") == NULL);
+}
+
+int main(void)
+{
+    test_states();
+    test_grow_reopen();
+    test_invalid();
+    return TEST_RESULT();
+}
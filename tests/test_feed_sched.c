@@ -0,0 +1,155 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "feed_sched.h"
+#include "test.h"
+
+/* - - - - */
+
+#define HOUR (60*60)
+#define DAY  (HOUR*24)
+#define WEEK (DAY*7)
+
+/* Episodes every gap seconds ending at newest. */
+static void fill_history(feed_info_t *info, time_t newest, int64_t gap, size_t n)
+{
+    size_t i;
+
+    memset(info, 0, sizeof(*info));
+    for (i=0; i<n && i<FEED_HISTORY_LEN; i++)
+        info->history[i] = newest - (time_t)(gap*(int64_t)i);
+}
+
+/* - - - - */
+
+static void test_sy_period(void)
+{
+    CHECK(feed_sched_sy_period(NULL, NULL) == 0);
+    CHECK(feed_sched_sy_period("", "2") == 0);
+    CHECK(feed_sched_sy_period("fortnightly", NULL) == 0);
+
+    CHECK(feed_sched_sy_period("daily", NULL) == DAY);
+    CHECK(feed_sched_sy_period("hourly", "2") == HOUR/2);
+    CHECK(feed_sched_sy_period("weekly", "1") == WEEK);
+    CHECK(feed_sched_sy_period("monthly", "0") == DAY*30);
+    CHECK(feed_sched_sy_period("yearly", "bad") == DAY*365);
+}
+
+static void test_rrule_period(void)
+{
+    CHECK(feed_sched_rrule_period(NULL) == 0);
+    CHECK(feed_sched_rrule_period("") == 0);
+    CHECK(feed_sched_rrule_period("FREQ=SECONDLY") == 0);
+    CHECK(feed_sched_rrule_period("INTERVAL=2") == 0);
+
+    CHECK(feed_sched_rrule_period("FREQ=DAILY") == DAY);
+    CHECK(feed_sched_rrule_period("freq=daily") == DAY);
+    CHECK(feed_sched_rrule_period("FREQ=WEEKLY;INTERVAL=2") == WEEK*2);
+    CHECK(feed_sched_rrule_period("INTERVAL=3;FREQ=HOURLY") == HOUR*3);
+    CHECK(feed_sched_rrule_period("FREQ=MONTHLY;BYDAY=MO;INTERVAL=1") == DAY*30);
+}
+
+static void test_next(void)
+{
+    feed_info_t info;
+    time_t      now = 1700000000;
+
+    /* Nothing known means check every run. */
+    memset(&info, 0, sizeof(info));
+    CHECK(feed_sched_next(&info, now, 0) == now);
+    fill_history(&info, now, WEEK, 1);
+    CHECK(feed_sched_next(&info, now, 0) == now);
+
+    /* Weekly episodes are checked four times a week. */
+    fill_history(&info, now, WEEK, FEED_HISTORY_LEN);
+    CHECK(feed_sched_next(&info, now, 0) == now + WEEK/4);
+
+    /* One skipped episode doesn't change the typical gap. */
+    info.history[4] = 0;
+    memmove(&info.history[4], &info.history[5], (FEED_HISTORY_LEN-5)*sizeof(*info.history));
+    info.history[FEED_HISTORY_LEN-1] = 0;
+    CHECK(feed_sched_next(&info, now, 0) == now + WEEK/4);
+
+    /* The feed saying it updates more often wins. */
+    fill_history(&info, now, WEEK, FEED_HISTORY_LEN);
+    info.update_period = DAY;
+    CHECK(feed_sched_next(&info, now, 0) == now + DAY);
+    info.update_period = WEEK;
+    CHECK(feed_sched_next(&info, now, 0) == now + WEEK/4);
+
+    /* A new show with only a couple of episodes uses the hint. */
+    fill_history(&info, now, WEEK, 1);
+    info.update_period = DAY;
+    CHECK(feed_sched_next(&info, now, 0) == now + DAY);
+
+    /* No point checking before the response goes stale. */
+    fill_history(&info, now, WEEK, FEED_HISTORY_LEN);
+    info.ttl = 3*DAY;
+    CHECK(feed_sched_next(&info, now, 0) == now + 3*DAY);
+    info.ttl     = 0;
+    info.max_age = 4*DAY;
+    CHECK(feed_sched_next(&info, now, 0) == now + 4*DAY);
+
+    /* The maximum interval caps everything. */
+    CHECK(feed_sched_next(&info, now, DAY) == now + DAY);
+    info.max_age = 0;
+    CHECK(feed_sched_next(&info, now, HOUR) == now + HOUR);
+}
+
+static void test_due(void)
+{
+    feed_info_t info;
+    time_t      now = 1700000000;
+
+    memset(&info, 0, sizeof(info));
+    CHECK(feed_sched_due(&info, now));
+
+    info.next_check = now + DAY;
+    CHECK(!feed_sched_due(&info, now));
+
+    /* Close enough to be due this run. */
+    info.next_check = now + 60;
+    CHECK(feed_sched_due(&info, now));
+
+    info.next_check = now + DAY;
+    info.failures   = 1;
+    CHECK(feed_sched_due(&info, now));
+
+    info.failures = 0;
+    info.queued   = 1;
+    CHECK(feed_sched_due(&info, now));
+}
+
+int main(void)
+{
+    test_sy_period();
+    test_rrule_period();
+    test_next();
+    test_due();
+    return TEST_RESULT();
+}
@@ -0,0 +1,212 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "htable.h"
+#include "test.h"
+
+/* - - - - */
+
+/* Must match htable.c so keys that share a bucket can be picked. */
+#define BUCKETS 16
+
+static size_t frees = 0;
+
+static void count_free(void *val)
+{
+    (void)val;
+    frees++;
+}
+
+static uint64_t fnv1a(const char *key)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    while (*key != '\0') {
+        h ^= (unsigned char)*key++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Find a key "k<n>" that lands in the given bucket of a new table. */
+static void key_for_bucket(size_t bucket, unsigned *n, char *out, size_t len)
+{
+    do {
+        snprintf(out, len, "k%u", (*n)++);
+    } while ((fnv1a(out) & (BUCKETS-1)) != bucket);
+}
+
+static bool count_cb(const char *key, void *val, void *thunk)
+{
+    (void)key;
+    (void)val;
+    (*(size_t *)thunk)++;
+    return true;
+}
+
+/* - - - - */
+
+static void test_basic(void)
+{
+    htable_t *ht;
+    void     *val;
+    int       a = 1;
+    int       b = 2;
+    size_t    visited = 0;
+
+    ht = htable_create(NULL);
+    CHECK(htable_len(ht) == 0);
+    CHECK(!htable_get(ht, "a", NULL));
+
+    htable_insert(ht, "a", &a);
+    htable_insert(ht, "b", &b);
+    CHECK(htable_len(ht) == 2);
+    CHECK(htable_get(ht, "a", &val) && val == &a);
+    CHECK(htable_get(ht, "b", &val) && val == &b);
+
+    htable_insert(ht, "a", &b);
+    CHECK(htable_len(ht) == 2);
+    CHECK(htable_get(ht, "a", &val) && val == &b);
+
+    htable_foreach(ht, count_cb, &visited);
+    CHECK(visited == 2);
+
+    CHECK(htable_remove(ht, "a"));
+    CHECK(!htable_remove(ht, "a"));
+    CHECK(!htable_get(ht, "a", NULL));
+    CHECK(htable_len(ht) == 1);
+
+    htable_destroy(ht);
+}
+
+static void test_free(void)
+{
+    htable_t *ht;
+    int       vals[3];
+
+    frees = 0;
+    ht    = htable_create(count_free);
+
+    htable_insert(ht, "a", &vals[0]);
+    htable_insert(ht, "a", &vals[1]);
+    CHECK(frees == 1);
+
+    /* Inserting the value that's already there must not free it. */
+    htable_insert(ht, "a", &vals[1]);
+    CHECK(frees == 1);
+
+    htable_insert(ht, "b", &vals[2]);
+    htable_remove(ht, "b");
+    CHECK(frees == 2);
+
+    htable_destroy(ht);
+    CHECK(frees == 3);
+}
+
+/* Removing from the middle of a probe run must shift the rest of the
+ * run back, including entries whose home bucket is after the hole. */
+static void test_backward_shift(void)
+{
+    htable_t *ht;
+    char      keys[5][16];
+    unsigned  n = 0;
+    size_t    i;
+
+    /* Three keys share bucket 3, one belongs in 4 and one in 5. In
+     * insertion order they fill buckets 3 to 7. */
+    key_for_bucket(3, &n, keys[0], sizeof(keys[0]));
+    key_for_bucket(3, &n, keys[1], sizeof(keys[1]));
+    key_for_bucket(4, &n, keys[2], sizeof(keys[2]));
+    key_for_bucket(3, &n, keys[3], sizeof(keys[3]));
+    key_for_bucket(5, &n, keys[4], sizeof(keys[4]));
+
+    ht = htable_create(NULL);
+    for (i=0; i<5; i++)
+        htable_insert(ht, keys[i], keys[i]);
+
+    CHECK(htable_remove(ht, keys[0]));
+    for (i=1; i<5; i++)
+        CHECK(htable_get(ht, keys[i], NULL));
+
+    CHECK(htable_remove(ht, keys[2]));
+    CHECK(htable_get(ht, keys[1], NULL));
+    CHECK(htable_get(ht, keys[3], NULL));
+    CHECK(htable_get(ht, keys[4], NULL));
+
+    /* Filling the hole again must not create a duplicate. */
+    htable_insert(ht, keys[4], keys[4]);
+    CHECK(htable_len(ht) == 3);
+    CHECK(htable_remove(ht, keys[4]));
+    CHECK(!htable_get(ht, keys[4], NULL));
+
+    htable_destroy(ht);
+}
+
+static void test_many(void)
+{
+    htable_t *ht;
+    char      key[16];
+    void     *val;
+    size_t    i;
+    bool      ok;
+
+    ht = htable_create(NULL);
+    for (i=0; i<5000; i++) {
+        snprintf(key, sizeof(key), "%zu", i);
+        htable_insert(ht, key, (void *)(i+1));
+    }
+    CHECK(htable_len(ht) == 5000);
+
+    for (i=0; i<5000; i+=2) {
+        snprintf(key, sizeof(key), "%zu", i);
+        htable_remove(ht, key);
+    }
+    CHECK(htable_len(ht) == 2500);
+
+    ok = true;
+    for (i=0; i<5000; i++) {
+        snprintf(key, sizeof(key), "%zu", i);
+        if (i%2 == 0) {
+            ok = ok && !htable_get(ht, key, NULL);
+        } else {
+            ok = ok && htable_get(ht, key, &val) && val == (void *)(i+1);
+        }
+    }
+    CHECK(ok);
+
+    htable_destroy(ht);
+}
+
+int main(void)
+{
+    test_basic();
+    test_free();
+    test_backward_shift();
+    test_many();
+    return TEST_RESULT();
+}
@@ -0,0 +1,130 @@
+/* The MIT License
+ * 
+ * Copyright (c) 2017 John Schember <john@nachtimwald.com>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sha256.h"
+#include "test.h"
+#include "xmem.h"
+
+/* - - - - */
+
+static const char *ONE_BLOCK = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+static bool digest_is(const sha256_t *ctx, const char *expect)
+{
+    char hex[SHA256_HEX_LEN];
+
+    sha256_digest_hex(ctx, hex);
+    return strcmp(hex, expect) == 0;
+}
+
+/* - - - - */
+
+/* FIPS 180-2 examples. */
+static void test_vectors(void)
+{
+    sha256_t *ctx;
+    char      buf[1000];
+    size_t    i;
+
+    ctx = sha256_create();
+    CHECK(digest_is(ctx, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+
+    sha256_update(ctx, "abc", 3);
+    CHECK(digest_is(ctx, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    CHECK(sha256_len(ctx) == 3);
+
+    sha256_reset(ctx);
+    sha256_update(ctx, ONE_BLOCK, strlen(ONE_BLOCK));
+    CHECK(digest_is(ctx, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+
+    sha256_reset(ctx);
+    memset(buf, 'a', sizeof(buf));
+    for (i=0; i<1000; i++)
+        sha256_update(ctx, buf, sizeof(buf));
+    CHECK(digest_is(ctx, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"));
+    CHECK(sha256_len(ctx) == 1000000);
+
+    sha256_destroy(ctx);
+}
+
+/* Getting the digest must not stop the hash from being continued. */
+static void test_digest_continue(void)
+{
+    sha256_t *ctx;
+
+    ctx = sha256_create();
+    sha256_update(ctx, "a", 1);
+    CHECK(digest_is(ctx, "ca978112ca1bbdcafac231b39a23dc4da786eff8147c4e72b9807785afee48bb"));
+    sha256_update(ctx, "bc", 2);
+    CHECK(digest_is(ctx, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    sha256_destroy(ctx);
+}
+
+/* A hash saved part way through, at and between block
+ * boundaries, must continue to the same digest. */
+static void test_state(void)
+{
+    sha256_t *ctx;
+    sha256_t *resumed;
+    char     *state;
+    size_t    len   = strlen(ONE_BLOCK);
+    size_t    split;
+
+    ctx     = sha256_create();
+    resumed = sha256_create();
+
+    for (split=0; split<=len; split++) {
+        sha256_reset(ctx);
+        sha256_update(ctx, ONE_BLOCK, split);
+        state = sha256_state_save(ctx);
+
+        sha256_update(resumed, "x", 1);
+        CHECK(sha256_state_load(resumed, state));
+        CHECK(sha256_len(resumed) == split);
+        sha256_update(resumed, ONE_BLOCK+split, len-split);
+        CHECK(digest_is(resumed, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+
+        xfree(state);
+    }
+
+    sha256_update(resumed, "x", 1);
+    CHECK(!sha256_state_load(resumed, "not a state"));
+    CHECK(sha256_len(resumed) == 0);
+    CHECK(!sha256_state_load(resumed, ""));
+
+    sha256_destroy(resumed);
+    sha256_destroy(ctx);
+}
+
+int main(void)
+{
+    test_vectors();
+    test_digest_continue();
+    test_state();
+    return TEST_RESULT();
+}